@@ -0,0 +1,183 @@
+
+#include <cstddef>
+#include <cstring>
+
+#include "binaryprotocol.h"
+
+static inline void Store32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void Store64(uint8_t *p, uint64_t v) {
+    Store32(p, (uint32_t)v);
+    Store32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t Load32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t Load64(const uint8_t *p) {
+    return (uint64_t)Load32(p) | (uint64_t)Load32(p + 4) << 32;
+}
+
+static inline bool IsMass(CommandType type) {
+    return type == CommandType_MassCancel || type == CommandType_MassAmend;
+}
+
+void EncodeCommand(const Command &command, uint8_t *wire) {
+    memset(wire, 0, sizeof(BinaryCommand));
+    wire[offsetof(BinaryCommand, type)] = (uint8_t)command.type;
+    wire[offsetof(BinaryCommand, side)] = (uint8_t)command.side;
+    Store32(wire + offsetof(BinaryCommand, orderId), (uint32_t)command.orderId);
+    Store32(wire + offsetof(BinaryCommand, qty), (uint32_t)command.qty);
+    if(command.type == CommandType_NewOrder) {
+        if(command.tif != TimeInForce_Day) wire[offsetof(BinaryCommand, tif)] = (uint8_t)command.tif;
+        if(command.orderType != OrderType_Limit) wire[offsetof(BinaryCommand, orderType)] = (uint8_t)command.orderType;
+        if(command.tif == TimeInForce_GTD) Store32(wire + offsetof(BinaryCommand, time), command.time);
+    }
+    if(command.type == CommandType_Clock) Store32(wire + offsetof(BinaryCommand, time), command.time);
+    if(command.type != CommandType_NewOrder && command.type != CommandType_Amend && !IsMass(command.type)) return;
+    if(command.tick != InvalidTick)
+        Store64(wire + offsetof(BinaryCommand, pxMills), (uint64_t)TickToMills(command.tick));
+    if(IsMass(command.type) && command.tick != InvalidTick)
+        Store32(wire + offsetof(BinaryCommand, rangeTicks), (uint32_t)(command.lastTick - command.tick));
+}
+
+bool DecodeCommand(const uint8_t *wire, Command &command) {
+    command.type = (CommandType)wire[offsetof(BinaryCommand, type)];
+    command.side = (OrderSide)wire[offsetof(BinaryCommand, side)];
+    command.orderId = (int32_t)Load32(wire + offsetof(BinaryCommand, orderId));
+    command.qty = (int32_t)Load32(wire + offsetof(BinaryCommand, qty));
+    bool sideOk = command.side == OrderSide::OrderSide_Buy || command.side == OrderSide::OrderSide_Sell;
+
+    switch(command.type) {
+        case CommandType_NewOrder: {
+            int64_t mills = (int64_t)Load64(wire + offsetof(BinaryCommand, pxMills));
+            uint8_t tif = wire[offsetof(BinaryCommand, tif)];
+            uint8_t orderType = wire[offsetof(BinaryCommand, orderType)];
+            command.tif = tif? (TimeInForce)tif: TimeInForce_Day;
+            command.orderType = orderType? (OrderType)orderType: OrderType_Limit;
+            if(!sideOk || command.orderId < 0 || command.qty <= 0 || !ValidOrderType(command.orderType, command.tif)) return false;
+            command.time = command.tif == TimeInForce_GTD? Load32(wire + offsetof(BinaryCommand, time)): 0;
+            if(command.orderType == OrderType_Market) {
+                command.tick = InvalidTick;
+                return !mills;
+            }
+            return MillsToTick(mills, command.tick);
+        }
+        case CommandType_Amend: {
+            int64_t mills = (int64_t)Load64(wire + offsetof(BinaryCommand, pxMills));
+            command.tick = InvalidTick;
+            return command.orderId >= 0 && command.qty > 0 && (!mills || MillsToTick(mills, command.tick));
+        }
+        case CommandType_Cancel:
+            return command.orderId >= 0;
+        case CommandType_QueryLevel:
+            return sideOk;
+        case CommandType_QueryOrder:
+            return true;
+        case CommandType_MassCancel:
+        case CommandType_MassAmend: {
+            int64_t mills = (int64_t)Load64(wire + offsetof(BinaryCommand, pxMills));
+            int32_t rangeTicks = (int32_t)Load32(wire + offsetof(BinaryCommand, rangeTicks));
+            bool bothOk = command.type == CommandType_MassCancel && command.side == BothSides;
+            if(!(sideOk || bothOk) || (command.type == CommandType_MassAmend && command.qty <= 0)) return false;
+            command.tick = command.lastTick = InvalidTick;
+            if(!mills) return !rangeTicks;
+            if(!MillsToTick(mills, command.tick) || rangeTicks < 0 || command.tick > INT_MAX - rangeTicks) return false;
+            command.lastTick = command.tick + rangeTicks;
+            return true;
+        }
+        case CommandType_Clock:
+            command.time = Load32(wire + offsetof(BinaryCommand, time));
+            return true;
+        case CommandType_QueryStats:
+        case CommandType_Snapshot:
+            return false;   //text protocol only
+    }
+    return false;
+}
+
+void EncodeReply(const Reply &reply, uint8_t *wire) {
+    memset(wire, 0, sizeof(BinaryReply));
+    wire[offsetof(BinaryReply, type)] = (uint8_t)reply.type;
+    Store32(wire + offsetof(BinaryReply, id), (uint32_t)reply.id);
+    switch(reply.type) {
+        case ReplyType_Level:
+            wire[offsetof(BinaryReply, side)] = (uint8_t)reply.side;
+            Store32(wire + offsetof(BinaryReply, qty), (uint32_t)reply.qty);
+            Store32(wire + offsetof(BinaryReply, count), (uint32_t)reply.count);
+            Store64(wire + offsetof(BinaryReply, pxMills), reply.tick == InvalidTick? 0: (uint64_t)TickToMills(reply.tick));
+            break;
+        case ReplyType_Order:
+            wire[offsetof(BinaryReply, status)] = (uint8_t)reply.status;
+            Store32(wire + offsetof(BinaryReply, qty), (uint32_t)reply.qty);
+            Store32(wire + offsetof(BinaryReply, count), (uint32_t)reply.count);
+            break;
+        case ReplyType_MassCancel:
+        case ReplyType_MassAmend:
+            wire[offsetof(BinaryReply, side)] = (uint8_t)reply.side;
+            Store32(wire + offsetof(BinaryReply, qty), (uint32_t)reply.qty);
+            Store32(wire + offsetof(BinaryReply, count), (uint32_t)reply.count);
+            break;
+        default:
+            break;
+    }
+}
+
+void DecodeReply(const uint8_t *wire, Reply &reply) {
+    reply.type = (ReplyType)wire[offsetof(BinaryReply, type)];
+    reply.side = (OrderSide)wire[offsetof(BinaryReply, side)];
+    reply.status = (OrderStatus)wire[offsetof(BinaryReply, status)];
+    reply.id = (int32_t)Load32(wire + offsetof(BinaryReply, id));
+    reply.qty = (int32_t)Load32(wire + offsetof(BinaryReply, qty));
+    reply.count = (int32_t)Load32(wire + offsetof(BinaryReply, count));
+    int64_t mills = (int64_t)Load64(wire + offsetof(BinaryReply, pxMills));
+    if(!mills || !MillsToTick(mills, reply.tick)) reply.tick = InvalidTick;
+}
+
+void EncodeEvent(const Event &event, uint8_t *wire) {
+    memset(wire, 0, sizeof(BinaryEvent));
+    wire[offsetof(BinaryEvent, type)] = (uint8_t)event.type;
+    wire[offsetof(BinaryEvent, status)] = (uint8_t)event.status;
+    wire[offsetof(BinaryEvent, aggressorStatus)] = (uint8_t)event.aggressorStatus;
+    Store32(wire + offsetof(BinaryEvent, orderId), (uint32_t)event.orderId);
+    Store32(wire + offsetof(BinaryEvent, restingId), (uint32_t)event.restingId);
+    Store32(wire + offsetof(BinaryEvent, qty), (uint32_t)event.qty);
+    Store64(wire + offsetof(BinaryEvent, pxMills), event.tick == InvalidTick? 0: (uint64_t)TickToMills(event.tick));
+}
+
+void DecodeEvent(const uint8_t *wire, Event &event) {
+    event.type = (EventType)wire[offsetof(BinaryEvent, type)];
+    event.status = (OrderStatus)wire[offsetof(BinaryEvent, status)];
+    event.aggressorStatus = (OrderStatus)wire[offsetof(BinaryEvent, aggressorStatus)];
+    event.orderId = (int32_t)Load32(wire + offsetof(BinaryEvent, orderId));
+    event.restingId = (int32_t)Load32(wire + offsetof(BinaryEvent, restingId));
+    event.qty = (int32_t)Load32(wire + offsetof(BinaryEvent, qty));
+    int64_t mills = (int64_t)Load64(wire + offsetof(BinaryEvent, pxMills));
+    if(!MillsToTick(mills, event.tick)) event.tick = InvalidTick;
+}
+
+void EncodeDepthUpdate(const DepthUpdate &update, uint8_t *wire) {
+    memset(wire, 0, sizeof(BinaryDepthUpdate));
+    wire[offsetof(BinaryDepthUpdate, type)] = (uint8_t)update.type;
+    wire[offsetof(BinaryDepthUpdate, side)] = (uint8_t)update.side;
+    Store32(wire + offsetof(BinaryDepthUpdate, qty), (uint32_t)update.qty);
+    Store32(wire + offsetof(BinaryDepthUpdate, count), (uint32_t)update.count);
+    if(update.tick != InvalidTick) {
+        Store64(wire + offsetof(BinaryDepthUpdate, pxMills), (uint64_t)TickToMills(update.tick));
+    }
+}
+
+void DecodeDepthUpdate(const uint8_t *wire, DepthUpdate &update) {
+    update.type = (DepthUpdateType)wire[offsetof(BinaryDepthUpdate, type)];
+    update.side = (OrderSide)wire[offsetof(BinaryDepthUpdate, side)];
+    update.qty = (int32_t)Load32(wire + offsetof(BinaryDepthUpdate, qty));
+    update.count = (int32_t)Load32(wire + offsetof(BinaryDepthUpdate, count));
+    int64_t mills = (int64_t)Load64(wire + offsetof(BinaryDepthUpdate, pxMills));
+    if(update.type == DepthUpdateType_Snapshot || !MillsToTick(mills, update.tick)) update.tick = InvalidTick;
+}
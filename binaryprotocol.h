@@ -0,0 +1,77 @@
+#ifndef ORDERBOOK_BINARYPROTOCOL_H
+#define ORDERBOOK_BINARYPROTOCOL_H
+
+#include <cstdint>
+
+#include "command.h"
+#include "events.h"
+#include "marketdata.h"
+
+//fixed-width little-endian records, one per message and one per reply, no delimiters
+//prices travel as fixed-point mills (1/1000), the book converts them to ticks
+
+struct BinaryCommand {
+    uint8_t type;           //CommandType
+    uint8_t side;           //OrderSide, 0 for a mass cancel of both sides
+    uint8_t tif;            //TimeInForce of new orders, 0 = day
+    uint8_t orderType;      //OrderType of new orders, 0 = limit
+    int32_t orderId;
+    int32_t qty;            //order/amend qty, level number for level queries
+    union {
+        int32_t rangeTicks; //mass cancel/amend: the range spans pxMills and the next rangeTicks ticks up
+        uint32_t time;      //expiry time of GTD new orders, the new time of clock commands
+    };
+    int64_t pxMills;        //new orders (0 for market orders), new price of amends (0 keeps the price)
+                            //lowest price of mass cancels/amends, 0 for all prices
+};
+
+struct BinaryReply {
+    uint8_t type;           //ReplyType
+    uint8_t side;           //OrderSide for level and mass replies, 0 for a mass cancel of both sides
+    uint8_t status;         //OrderStatus for order replies
+    uint8_t reserved;
+    int32_t id;             //level number for level replies, orderId otherwise
+    int32_t qty;            //level qty or leaves qty, canceled/leaves qty for mass replies
+    int32_t count;          //level order count or queue position, number of orders for mass replies
+    int64_t pxMills;        //level price, 0 if there is no such level
+};
+
+struct BinaryEvent {
+    uint8_t type;           //EventType
+    uint8_t status;         //OrderStatus of the resting order (fill) or of the order
+    uint8_t aggressorStatus; //OrderStatus of the aggressor after a fill
+    uint8_t reserved;
+    int32_t orderId;        //aggressor for fills
+    int32_t restingId;      //fills only
+    int32_t qty;
+    int64_t pxMills;        //0 for market orders
+};
+
+struct BinaryDepthUpdate {
+    uint8_t type;           //DepthUpdateType
+    uint8_t side;           //OrderSide, unused for snapshot headers
+    uint8_t reserved[2];
+    int32_t qty;            //level qty, number of bid levels for snapshot headers
+    int32_t count;          //level order count, number of ask levels for snapshot headers
+    int32_t reserved2;
+    int64_t pxMills;        //0 for snapshot headers
+};
+
+static_assert(sizeof(BinaryCommand) == 24, "BinaryCommand is a wire format");
+static_assert(sizeof(BinaryReply) == 24, "BinaryReply is a wire format");
+static_assert(sizeof(BinaryEvent) == 24, "BinaryEvent is a wire format");
+static_assert(sizeof(BinaryDepthUpdate) == 24, "BinaryDepthUpdate is a wire format");
+
+//encodes to/decodes from wire byte order, the buffers are exactly sizeof(record) bytes
+void EncodeCommand(const Command &command, uint8_t *wire);
+void EncodeReply(const Reply &reply, uint8_t *wire);
+void DecodeReply(const uint8_t *wire, Reply &reply);
+void EncodeEvent(const Event &event, uint8_t *wire);
+void DecodeEvent(const uint8_t *wire, Event &event);
+void EncodeDepthUpdate(const DepthUpdate &update, uint8_t *wire);
+void DecodeDepthUpdate(const uint8_t *wire, DepthUpdate &update);
+
+//false if the record is not a valid command, the same checks as the text protocol apply
+bool DecodeCommand(const uint8_t *wire, Command &command);
+
+#endif //ORDERBOOK_BINARYPROTOCOL_H
@@ -0,0 +1,137 @@
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "bookmanager.h"
+#include "textprotocol.h"
+
+using namespace std;
+
+BookManager::BookManager(int threads, bool pinCores, bool busyPoll) {
+    int cores = (int)thread::hardware_concurrency();
+    for(int i = 0; i < max(threads, 1); ++i) {
+        workers.emplace_back(new Worker());
+        Worker *worker = workers.back().get();
+        worker->thread = thread(Run, worker, busyPoll);
+        if(pinCores && cores > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((i + 1) % cores, &set);
+            pthread_setaffinity_np(worker->thread.native_handle(), sizeof(set), &set);
+        }
+    }
+}
+
+BookManager::~BookManager() {
+    for(auto &worker: workers) {
+        worker->stop.store(true, memory_order_release);
+    }
+    for(auto &worker: workers) {
+        worker->thread.join();
+    }
+}
+
+void BookManager::Run(Worker *worker, bool busyPoll) {
+    WaitStrategy wait(busyPoll);
+    OutputBuffer text;
+    for(;;) {
+        Job *job = worker->commands.Front();
+        if(!job) {
+            if(worker->stop.load(memory_order_acquire) && worker->commands.Empty()) return;
+            //spin for a while (a burst usually follows a burst), then yield, then sleep so a quiet symbol set costs no cores
+            wait.Idle();
+            continue;
+        }
+        wait.Reset();
+        Reply reply;
+        if(job->book->Execute(job->command, reply)) {
+            if(reply.type == ReplyType_Stats) {
+                //the text goes first, the reply tells the parser thread it is there
+                text.Clear();
+                job->book->AppendStats(text);
+                while(!worker->texts.TryPush(string(text.Data(), text.Size()))) CpuRelax();
+            }
+            while(!worker->replies.TryPush(reply)) CpuRelax();
+        }
+        worker->commands.Pop();
+    }
+}
+
+BookManager::Instrument &BookManager::GetInstrument(string_view symbol) {
+    auto it = instruments.find(symbol);
+    if(it != instruments.end()) return it->second;
+
+    Instrument &instrument = instruments[string(symbol)];
+    instrument.book.reset(new OrderBook());
+    instrument.worker = nextWorker;
+    nextWorker = (nextWorker + 1) % (int)workers.size();
+    return instrument;
+}
+
+OrderBook *BookManager::GetBook(string_view symbol) {
+    auto it = instruments.find(symbol);
+    return it == instruments.end()? NULL: it->second.book.get();
+}
+
+void BookManager::ProcessMessage(string_view message, OutputBuffer &output) {
+    size_t space = message.find(' ');
+    Job job;
+    if(space == 0 || space == string_view::npos || ParseMessage(message.substr(space + 1), job.command) != ParseError_None) {
+        if(pendingReplies.empty()) {
+            FormatInvalid(message, output);
+        } else {
+            pendingReplies.push_back(-1);
+            invalids.emplace_back(message);
+        }
+        return;
+    }
+
+    Instrument &instrument = GetInstrument(message.substr(0, space));
+    job.book = instrument.book.get();
+    Submit(instrument.worker, job, output);
+}
+
+void BookManager::Submit(int worker, const Job &job, OutputBuffer &output) {
+    bool hasReply = HasReply(job.command.type);
+    if(hasReply) pendingReplies.push_back(worker);
+
+    //a full queue means the worker is behind, keep draining replies so it can't block on its reply queue
+    while(!workers[worker]->commands.TryPush(job)) {
+        if(!DrainReady(output)) CpuRelax();
+    }
+    if(hasReply) DrainReady(output);
+}
+
+bool BookManager::DrainReady(OutputBuffer &output) {
+    bool drained = false;
+    while(!pendingReplies.empty()) {
+        int worker = pendingReplies.front();
+        if(worker < 0) {
+            FormatInvalid(invalids.front(), output);
+            invalids.pop_front();
+        } else {
+            Reply *reply = workers[worker]->replies.Front();
+            if(!reply) break;
+            if(reply->type == ReplyType_Stats) {
+                string *text = workers[worker]->texts.Front();
+                output.Append(*text);
+                workers[worker]->texts.Pop();
+            } else {
+                FormatReply(*reply, output);
+            }
+            workers[worker]->replies.Pop();
+        }
+        pendingReplies.pop_front();
+        drained = true;
+    }
+    return drained;
+}
+
+void BookManager::Flush(OutputBuffer &output) {
+    while(!pendingReplies.empty()) {
+        if(!DrainReady(output)) CpuRelax();
+    }
+    for(auto &worker: workers) {
+        while(!worker->commands.Empty()) CpuRelax();
+    }
+}
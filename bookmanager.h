@@ -0,0 +1,86 @@
+#ifndef ORDERBOOK_BOOKMANAGER_H
+#define ORDERBOOK_BOOKMANAGER_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "orderbook.h"
+#include "spscqueue.h"
+
+//one OrderBook per symbol, symbols are spread round-robin over worker threads
+//the calling (parser) thread decodes messages and hands them to the symbol's worker through a SPSC queue,
+//replies come back through a SPSC queue per worker and are written out in input order
+//messages carry the symbol as first token: AAPL order 1001 buy 100 12.30
+class BookManager {
+
+public:
+    static const size_t QueueSize = 1 << 14;
+
+    //pinCores: pin worker i to core (i + 1) % cores, core 0 is left to the parser thread
+    //busyPoll: idle workers spin instead of backing off to sleeps (see WaitStrategy), each one then burns its core
+    explicit BookManager(int threads, bool pinCores = true, bool busyPoll = false);
+    ~BookManager();
+
+    BookManager(const BookManager &) = delete;
+    BookManager &operator=(const BookManager &) = delete;
+
+    //queues one message, replies that are already available are appended to output
+    void ProcessMessage(std::string_view message, OutputBuffer &output);
+
+    //waits until every queued message has been executed and all replies are appended to output
+    void Flush(OutputBuffer &output);
+
+    //NULL if the symbol has never been seen, only safe to use after Flush
+    OrderBook *GetBook(std::string_view symbol);
+
+    int Threads() const { return (int)workers.size(); }
+
+    //f(std::string_view symbol, OrderBook &book) for every symbol in name order, only safe to use after Flush
+    template<typename F>
+    void ForEachBook(F f) {
+        for(auto &instrument: instruments) f(std::string_view(instrument.first), *instrument.second.book);
+    }
+
+private:
+    struct Job {
+        OrderBook *book;
+        Command command;
+    };
+
+    struct Worker {
+        Worker(): commands(QueueSize), replies(QueueSize), texts(QueueSize) {}
+        SpscQueue<Job> commands;
+        SpscQueue<Reply> replies;
+        SpscQueue<std::string> texts;   //stats replies, formatted by the worker that owns the counters
+        std::atomic<bool> stop{false};
+        std::thread thread;
+    };
+
+    struct Instrument {
+        std::unique_ptr<OrderBook> book;
+        int worker;
+    };
+
+    static void Run(Worker *worker, bool busyPoll);
+
+    Instrument &GetInstrument(std::string_view symbol);
+    void Submit(int worker, const Job &job, OutputBuffer &output);
+    bool DrainReady(OutputBuffer &output);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::map<std::string, Instrument, std::less<>> instruments;
+    int nextWorker = 0;
+
+    //source of each outstanding reply in input order: worker index, or -1 for an invalid message kept in invalids
+    std::deque<int> pendingReplies;
+    std::deque<std::string> invalids;
+};
+
+#endif //ORDERBOOK_BOOKMANAGER_H
@@ -0,0 +1,81 @@
+
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bookview.h"
+
+static const char Magic[8] = {'O', 'B', 'V', 'I', 'E', 'W', '1', 0};
+
+static void Init(SharedBookView *shared) {
+    memcpy(shared->magic, Magic, sizeof(Magic));
+    shared->viewSize = sizeof(BookView);
+    shared->sequence.store(0, std::memory_order_relaxed);
+    memset(&shared->view, 0, sizeof(shared->view));
+}
+
+BookViewPublisher::BookViewPublisher(): shared(new SharedBookView()) {
+    Init(shared);
+}
+
+BookViewPublisher::~BookViewPublisher() {
+    Release();
+}
+
+void BookViewPublisher::Release() {
+    if(mappedSize) munmap(shared, mappedSize); else delete shared;
+    shared = NULL;
+    mappedSize = 0;
+}
+
+bool BookViewPublisher::OpenShared(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+    size_t size = sizeof(SharedBookView);
+    if(ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) return false;
+
+    //carry over what was published so far, readers only ever see the mapping
+    SharedBookView *mapped = new(mapping) SharedBookView();
+    Init(mapped);
+    mapped->view = shared->view;
+    mapped->sequence.store(shared->sequence.load(std::memory_order_relaxed), std::memory_order_release);
+    Release();
+    shared = mapped;
+    mappedSize = size;
+    return true;
+}
+
+BookViewReader::~BookViewReader() {
+    if(mappedSize) munmap((void *)shared, mappedSize);
+}
+
+bool BookViewReader::OpenShared(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SharedBookView)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, sizeof(SharedBookView), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) return false;
+    const SharedBookView *mapped = (const SharedBookView *)mapping;
+    if(memcmp(mapped->magic, Magic, sizeof(Magic)) != 0 || mapped->viewSize != sizeof(BookView)) {
+        munmap(mapping, sizeof(SharedBookView));
+        return false;
+    }
+    if(mappedSize) munmap((void *)shared, mappedSize);
+    shared = mapped;
+    mappedSize = sizeof(SharedBookView);
+    return true;
+}
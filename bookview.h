@@ -0,0 +1,98 @@
+#ifndef ORDERBOOK_BOOKVIEW_H
+#define ORDERBOOK_BOOKVIEW_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "depthcache.h"
+#include "spscqueue.h"
+
+//top of the book as other threads and processes see it, plain data so it can live in shared memory
+struct BookView {
+    uint64_t version;                           //number of publications, a reader can tell whether anything changed
+    int32_t bidLevels;
+    int32_t askLevels;
+    DepthEntry bids[DepthCache::Levels];        //best first
+    DepthEntry asks[DepthCache::Levels];
+};
+
+//seqlock around one BookView: the writer makes the sequence odd, writes, makes it even again
+//a reader copies the view and keeps the copy only if the sequence was the same even number before and after
+//readers never write to it, so any number of them can poll without slowing down the writer or each other
+struct SharedBookView {
+    char magic[8];                              //"OBVIEW1"
+    uint32_t viewSize;                          //sizeof(BookView)
+    alignas(64) std::atomic<uint64_t> sequence;
+    BookView view;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence is shared between processes");
+
+//single writer side, owned by the thread that runs the book
+//the view lives on the heap, or in a file mapping (put it on /dev/shm) for readers in other processes
+class BookViewPublisher {
+
+public:
+    BookViewPublisher();
+    ~BookViewPublisher();
+    BookViewPublisher(const BookViewPublisher &) = delete;
+    BookViewPublisher &operator=(const BookViewPublisher &) = delete;
+
+    //moves the view into a shared mapping of path, created or truncated
+    bool OpenShared(const char *path);
+
+    void Publish(const DepthCache &bids, const DepthCache &asks) {
+        uint64_t seq = shared->sequence.load(std::memory_order_relaxed);
+        shared->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        BookView &view = shared->view;
+        view.version = seq / 2 + 1;
+        view.bidLevels = bids.Size();
+        view.askLevels = asks.Size();
+        for(int i = 0; i < bids.Size(); ++i) view.bids[i] = bids[i];
+        for(int i = 0; i < asks.Size(); ++i) view.asks[i] = asks[i];
+        shared->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    const SharedBookView *Shared() const { return shared; }
+
+private:
+    void Release();
+
+    SharedBookView *shared;
+    size_t mappedSize = 0;      //0 while the view is on the heap
+};
+
+//reader side, any thread, any process
+class BookViewReader {
+
+public:
+    explicit BookViewReader(const SharedBookView *shared = NULL): shared(shared) {}
+    ~BookViewReader();
+    BookViewReader(const BookViewReader &) = delete;
+    BookViewReader &operator=(const BookViewReader &) = delete;
+
+    //maps the view published at path read-only
+    bool OpenShared(const char *path);
+
+    //one attempt, false if the writer was in the middle of a publication
+    bool TryRead(BookView &view) const {
+        uint64_t before = shared->sequence.load(std::memory_order_acquire);
+        if(before & 1) return false;
+        memcpy(&view, &shared->view, sizeof(view));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return shared->sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    //spins until it gets a consistent copy, the writer only holds the odd sequence for a few stores
+    void Read(BookView &view) const {
+        while(!TryRead(view)) CpuRelax();
+    }
+
+private:
+    const SharedBookView *shared;
+    size_t mappedSize = 0;
+};
+
+#endif //ORDERBOOK_BOOKVIEW_H
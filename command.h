@@ -0,0 +1,77 @@
+#ifndef ORDERBOOK_COMMAND_H
+#define ORDERBOOK_COMMAND_H
+
+#include "order.h"
+
+typedef enum CommandType {
+    CommandType_NewOrder = 'N',
+    CommandType_Amend = 'M',
+    CommandType_Cancel = 'X',
+    CommandType_QueryLevel = 'L',
+    CommandType_QueryOrder = 'Q',
+    CommandType_QueryStats = 'S',    //text protocol only, answered with the book's BookStats (ReplyType_Stats)
+    CommandType_Snapshot = 'P',      //text protocol only, saves the book to its snapshot file
+    CommandType_MassCancel = 'C',    //every order of a side (or both) within a price range
+    CommandType_MassAmend = 'A',     //new qty for every order of a side within a price range
+    CommandType_Clock = 'T',         //moves the book's logical clock forward, expiring GTD orders that fall due
+} CommandType;
+
+//true for the commands Execute answers with a Reply, queries and mass commands
+inline bool HasReply(CommandType type) {
+    switch(type) {
+        case CommandType_QueryLevel:
+        case CommandType_QueryOrder:
+        case CommandType_QueryStats:
+        case CommandType_MassCancel:
+        case CommandType_MassAmend:
+            return true;
+        case CommandType_NewOrder:
+        case CommandType_Amend:
+        case CommandType_Cancel:
+        case CommandType_Snapshot:
+        case CommandType_Clock:
+            break;
+    }
+    return false;
+}
+
+//side of a MassCancel that takes both sides
+const OrderSide BothSides = (OrderSide)0;
+
+//pre-decoded message, prices are already in ticks
+struct Command {
+    CommandType type;
+    OrderSide side;     //NewOrder, QueryLevel, MassCancel, MassAmend
+    int orderId;        //NewOrder, Amend, Cancel, QueryOrder
+    int qty;            //NewOrder, Amend, MassAmend; level number for QueryLevel
+    Tick tick;          //NewOrder (InvalidTick for market orders); Amend: new price, InvalidTick keeps the price
+                        //MassCancel, MassAmend: lowest price of the range, InvalidTick for all prices
+    OrderType orderType = OrderType_Limit;  //NewOrder
+    TimeInForce tif = TimeInForce_Day;      //NewOrder
+    Tick lastTick = InvalidTick;            //MassCancel, MassAmend: highest price of the range, inclusive
+    Timestamp time = 0;                     //NewOrder with TimeInForce_GTD: expiry time; Clock: the new time
+};
+
+typedef enum ReplyType {
+    ReplyType_None = 0,
+    ReplyType_Level = 'L',
+    ReplyType_Order = 'O',
+    ReplyType_OrderNotFound = 'U',
+    ReplyType_Invalid = 'E',
+    ReplyType_MassCancel = 'C',
+    ReplyType_MassAmend = 'A',
+    ReplyType_Stats = 'S',          //no fields, the text comes from OrderBook::AppendStats on the thread that runs the book
+} ReplyType;
+
+//result of a command, protocols format it on their own
+struct Reply {
+    ReplyType type;
+    OrderSide side;         //Level, MassCancel, MassAmend
+    OrderStatus status;     //Order
+    int id;                 //level number for Level, orderId otherwise (0 for mass replies)
+    int qty;                //Level: total qty, Order: leaves qty, MassCancel: canceled qty, MassAmend: leaves qty after the amend
+    int count;              //Level: number of orders, Order: queue position, mass replies: number of orders
+    Tick tick;              //Level: price, InvalidTick if there is no such level
+};
+
+#endif //ORDERBOOK_COMMAND_H
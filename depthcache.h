@@ -0,0 +1,71 @@
+#ifndef ORDERBOOK_DEPTHCACHE_H
+#define ORDERBOOK_DEPTHCACHE_H
+
+#include "priceladder.h"
+
+struct DepthEntry {
+    Tick tick;
+    int qty;
+    int count;
+};
+
+//top Levels price levels of one side, best first, kept up to date on every level change
+//invariant: holds the best min(Levels, number of non-empty levels) levels of the ladder
+class DepthCache {
+
+public:
+    static const int Levels = 10;
+
+    int Size() const { return size; }
+    const DepthEntry &operator[](int i) const { return entries[i]; }
+
+    //true when the cache holds every level of the side, so a miss means there is no such level
+    bool Complete() const { return size < Levels; }
+
+    //to be called after the level at tick changed in any way (added, emptied, qty or count changed)
+    //returns false if the change was behind the cached levels, so the cache stayed the same
+    template<typename Ladder>
+    bool Update(Ladder &ladder, Tick tick) {
+        PriceLevel *level = ladder.Find(tick);
+        int i = 0;
+        while(i < size && ladder.Better(entries[i].tick, tick)) ++i;
+        //entries[i] is the level itself or the first one behind it (i == size if none)
+
+        if(i < size && entries[i].tick == tick) {
+            if(level) {
+                entries[i].qty = level->qty;
+                entries[i].count = level->count;
+                return true;
+            }
+            //level is gone, pull the next one from behind the cache
+            bool wasFull = size == Levels;
+            for(int j = i + 1; j < size; ++j) entries[j - 1] = entries[j];
+            --size;
+            if(wasFull) {
+                Tick next = ladder.NextTick(entries[size - 1].tick);
+                if(next != InvalidTick) Set(size++, ladder, next);
+            }
+            return true;
+        }
+
+        if(!level || (i == size && size == Levels)) return false;   //nothing to show or behind the cache
+        if(size < Levels) ++size;
+        for(int j = size - 1; j > i; --j) entries[j] = entries[j - 1];
+        Set(i, ladder, tick);
+        return true;
+    }
+
+private:
+    template<typename Ladder>
+    void Set(int i, Ladder &ladder, Tick tick) {
+        PriceLevel *level = ladder.Find(tick);
+        entries[i].tick = tick;
+        entries[i].qty = level->qty;
+        entries[i].count = level->count;
+    }
+
+    DepthEntry entries[Levels];
+    int size = 0;
+};
+
+#endif //ORDERBOOK_DEPTHCACHE_H
@@ -0,0 +1,47 @@
+#ifndef ORDERBOOK_EVENTS_H
+#define ORDERBOOK_EVENTS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "order.h"
+
+typedef enum EventType {
+    EventType_Fill = 'F',
+    EventType_Amend = 'M',
+    EventType_Cancel = 'X',
+    EventType_Reject = 'R',         //FOK without enough liquidity, post-only that would trade
+} EventType;
+
+//execution report pushed by the book as things happen
+struct Event {
+    EventType type;
+    OrderStatus status;             //resulting status of the resting order (Fill) or of the order (Amend, Cancel)
+    OrderStatus aggressorStatus;    //Fill: status of the aggressor after this fill
+    int orderId;                    //Fill: aggressor, Amend/Cancel: the order
+    int restingId;                  //Fill: resting order, 0 otherwise
+    int qty;                        //Fill: executed qty, Amend: new order qty, Cancel/Reject: canceled leaves qty
+    Tick tick;                      //Fill: execution price (resting price), order price otherwise (InvalidTick for market orders)
+};
+
+//events of the current message/batch, the consumer drains it with Clear()
+//storage is kept between batches, so steady state does not allocate
+class EventBuffer {
+
+public:
+    void Push(const Event &event) {
+        if(size == events.size()) events.resize(events.empty()? 1024: events.size() * 2);
+        events[size++] = event;
+    }
+
+    const Event *Data() const { return events.data(); }
+    size_t Size() const { return size; }
+    bool Empty() const { return !size; }
+    void Clear() { size = 0; }
+
+private:
+    std::vector<Event> events;
+    size_t size = 0;
+};
+
+#endif //ORDERBOOK_EVENTS_H
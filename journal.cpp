@@ -0,0 +1,119 @@
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+using namespace std;
+
+static const char Magic[8] = {'O', 'B', 'J', 'R', 'N', 'L', '1', 0};
+
+static size_t PageSize() {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+bool Journal::Open(const char *path, bool syncCommit, size_t capacity) {
+    Close();
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        Close();
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    capacity = max(max(capacity, size), HeaderSize + sizeof(BinaryCommand));
+    //real blocks, not a sparse file, so appending can't run out of disk half way through a page
+    if(posix_fallocate(fd, 0, (off_t)capacity) != 0 && ftruncate(fd, (off_t)capacity) < 0) {
+        Close();
+        return false;
+    }
+    void *mapping = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    data = (uint8_t *)mapping;
+    this->capacity = capacity;
+    this->syncCommit = syncCommit;
+    failed = false;
+
+    if(!size || !data[0]) {
+        //new, or created by a run that died before it wrote the header
+        memset(data, 0, HeaderSize);
+        memcpy(data, Magic, sizeof(Magic));
+        data[sizeof(Magic)] = (uint8_t)sizeof(BinaryCommand);
+        end = committed = HeaderSize;
+        msync(data, HeaderSize, MS_SYNC);
+        return true;
+    }
+    if(memcmp(data, Magic, sizeof(Magic)) != 0 || data[sizeof(Magic)] != sizeof(BinaryCommand)) {
+        //not a journal, don't touch it
+        Close();
+        return false;
+    }
+
+    //the log ends at the zero fill, or at a record torn by a crash
+    Command command;
+    end = HeaderSize;
+    while(end + sizeof(BinaryCommand) <= capacity && DecodeCommand(data + end, command)) {
+        end += sizeof(BinaryCommand);
+    }
+    //a torn record would be taken for the end again after the next restart, clear it
+    if(end + sizeof(BinaryCommand) <= capacity) memset(data + end, 0, sizeof(BinaryCommand));
+    committed = end;
+    return true;
+}
+
+void Journal::Close() {
+    if(data) {
+        msync(data, end, MS_SYNC);
+        munmap(data, capacity);
+        data = NULL;
+    }
+    if(fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    capacity = 0;
+    end = committed = HeaderSize;
+}
+
+bool Journal::Commit() {
+    if(failed) return false;
+    if(end == committed) return true;
+    //msync wants a page aligned start
+    size_t from = committed & ~(PageSize() - 1);
+    if(msync(data + from, end - from, syncCommit? MS_SYNC: MS_ASYNC) < 0) {
+        failed = true;
+        return false;
+    }
+    committed = end;
+    return true;
+}
+
+bool Journal::Sync() {
+    if(!Commit()) return false;
+    if(!syncCommit && msync(data, end, MS_SYNC) < 0) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool Journal::Grow() {
+    size_t grown = capacity * 2;
+    if(posix_fallocate(fd, 0, (off_t)grown) != 0 && ftruncate(fd, (off_t)grown) < 0) return false;
+    void *mapping = mremap(data, capacity, grown, MREMAP_MAYMOVE);
+    if(mapping == MAP_FAILED) return false;
+    data = (uint8_t *)mapping;
+    capacity = grown;
+    return true;
+}
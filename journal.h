@@ -0,0 +1,83 @@
+#ifndef ORDERBOOK_JOURNAL_H
+#define ORDERBOOK_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "binaryprotocol.h"
+#include "command.h"
+
+//append-only write-ahead log of the commands that change the book (new, amend, cancel)
+//records are BinaryCommand, behind a small header, in a preallocated file that is mmap'd shared,
+//so appending is a copy into the page cache and Commit() msyncs whatever was appended since the last one
+//the file is zero filled past the last record, recovery stops at the first record that does not decode
+class Journal {
+
+public:
+    static const size_t HeaderSize = 64;
+    static const size_t DefaultCapacity = 64 << 20;     //preallocated bytes, doubled whenever it fills up
+
+    Journal() {}
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+    ~Journal() { Close(); }
+
+    //opens or creates the journal at path, records already in it are kept and appending continues after them
+    //syncCommit: Commit() waits for the disk (MS_SYNC), otherwise it only schedules the write-back (MS_ASYNC)
+    bool Open(const char *path, bool syncCommit = false, size_t capacity = DefaultCapacity);
+    void Close();
+
+    bool IsOpen() const { return data != NULL; }
+    size_t Records() const { return (end - HeaderSize) / sizeof(BinaryCommand); }
+
+    //executes the records from record first on, straight from the mapping, no parsing and no replies
+    //returns the number of records executed
+    //pre-condition: the journal is not attached to book yet, or replay would append to it again
+    template<typename Book>
+    size_t Replay(Book &book, size_t first = 0) const {
+        Command command;
+        Reply reply;
+        size_t pos = HeaderSize + first * sizeof(BinaryCommand);
+        for(; pos < end; pos += sizeof(BinaryCommand)) {
+            DecodeCommand(data + pos, command);
+            book.Execute(command, reply);
+        }
+        return first < Records()? Records() - first: 0;
+    }
+
+    //false if the command does not survive its own encoding, it is not written then:
+    //Open would take such a record for the end of the log and drop every record behind it
+    bool Append(const Command &command) {
+        if(end + sizeof(BinaryCommand) > capacity && !Grow()) {
+            failed = true;
+            return true;
+        }
+        Command check;
+        EncodeCommand(command, data + end);
+        if(!DecodeCommand(data + end, check)) {
+            memset(data + end, 0, sizeof(BinaryCommand));
+            return false;
+        }
+        end += sizeof(BinaryCommand);
+        return true;
+    }
+
+    //group commit of everything appended so far, false if the journal could not keep up (disk full, I/O error)
+    bool Commit();
+    //like Commit, but waits until every record is on disk whatever syncCommit says
+    bool Sync();
+
+private:
+    bool Grow();
+
+    int fd = -1;
+    uint8_t *data = NULL;
+    size_t capacity = 0;
+    size_t end = HeaderSize;        //offset behind the last record
+    size_t committed = HeaderSize;  //offset up to which Commit() has been issued
+    bool syncCommit = false;
+    bool failed = false;
+};
+
+#endif //ORDERBOOK_JOURNAL_H
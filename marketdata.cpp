@@ -0,0 +1,44 @@
+
+#include "marketdata.h"
+
+using namespace std;
+
+static inline size_t Hash(uint64_t key) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+void MarketDataPublisher::OnLevel(OrderSide side, Tick tick, int qty, int count) {
+    if(conflate) {
+        if((used + 1) * 2 > slots.size()) Grow();
+        uint64_t key = (uint64_t)side << 32 | (uint32_t)tick;
+        size_t mask = slots.size() - 1;
+        for(size_t i = Hash(key) & mask; ; i = (i + 1) & mask) {
+            Slot &slot = slots[i];
+            if(slot.generation != generation) {
+                slot.key = key;
+                slot.generation = generation;
+                slot.index = (uint32_t)updates.size();
+                ++used;
+                break;
+            }
+            if(slot.key == key) {
+                updates[slot.index].qty = qty;
+                updates[slot.index].count = count;
+                return;
+            }
+        }
+    }
+    updates.push_back(DepthUpdate{DepthUpdateType_Delta, side, tick, qty, count});
+}
+
+void MarketDataPublisher::Grow() {
+    vector<Slot> old(max(slots.size() * 2, (size_t)1024));
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for(const Slot &slot: old) {
+        if(slot.generation != generation) continue;
+        size_t i = Hash(slot.key) & mask;
+        while(slots[i].generation == generation) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef ORDERBOOK_MARKETDATA_H
+#define ORDERBOOK_MARKETDATA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "order.h"
+
+typedef enum DepthUpdateType {
+    DepthUpdateType_Delta = 'D',        //a level changed, qty = count = 0 means it is gone
+    DepthUpdateType_Snapshot = 'S',     //start of a full snapshot, qty = number of bid levels, count = number of ask levels
+    DepthUpdateType_Level = 'L',        //one level of the snapshot, bids best first then asks best first
+} DepthUpdateType;
+
+struct DepthUpdate {
+    DepthUpdateType type;
+    OrderSide side;
+    Tick tick;
+    int qty;
+    int count;
+};
+
+//collects incremental level updates from the book until the consumer drains them
+//with conflation, repeated updates to the same level within one drain interval are merged into the first one,
+//so consumers only see the latest state of each level that changed
+class MarketDataPublisher {
+
+public:
+    explicit MarketDataPublisher(bool conflate = false): conflate(conflate) {}
+
+    void OnLevel(OrderSide side, Tick tick, int qty, int count);
+
+    //appends a full snapshot, walks every level of the book
+    template<typename Book>
+    void Snapshot(Book &book) {
+        size_t header = updates.size();
+        updates.push_back(DepthUpdate{DepthUpdateType_Snapshot, OrderSide::OrderSide_Buy, InvalidTick, 0, 0});
+        int levels[2] = {0, 0};
+        for(OrderSide side: {OrderSide::OrderSide_Buy, OrderSide::OrderSide_Sell}) {
+            int &n = levels[side == OrderSide::OrderSide_Sell];
+            book.ForEachLevel(side, [this, side, &n](Tick tick, int qty, int count) {
+                updates.push_back(DepthUpdate{DepthUpdateType_Level, side, tick, qty, count});
+                ++n;
+            });
+        }
+        updates[header].qty = levels[0];
+        updates[header].count = levels[1];
+        ResetConflation();  //later deltas must come after the snapshot
+    }
+
+    const DepthUpdate *Data() const { return updates.data(); }
+    size_t Size() const { return updates.size(); }
+    bool Empty() const { return updates.empty(); }
+    void Clear() {
+        updates.clear();
+        ResetConflation();
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint32_t generation;
+        uint32_t index;
+    };
+
+    void ResetConflation() { ++generation; used = 0; }
+    void Grow();
+
+    bool conflate;
+    std::vector<DepthUpdate> updates;
+
+    //(side, tick) -> index in updates for the current interval, slots of older generations count as empty
+    std::vector<Slot> slots;
+    uint32_t generation = 1;
+    size_t used = 0;
+};
+
+#endif //ORDERBOOK_MARKETDATA_H
@@ -0,0 +1,106 @@
+#ifndef ORDERBOOK_ORDER_H
+#define ORDERBOOK_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "ticktable.h"
+
+//one byte each (FIX chars), so they pack into the hot part of an Order
+typedef enum OrderSide : char {
+    OrderSide_Buy = 'B',
+    OrderSide_Sell = 'S',
+} Side;
+
+typedef enum OrderStatus : char {
+    OrderStatus_New = '0',
+    OrderStatus_PartiallyFilled = '1',
+    OrderStatus_Filled = '2',
+    OrderStatus_Canceled = '4',
+    OrderStatus_Rejected = '8',
+    OrderStatus_Expired = 'C',
+} OrderStatus;
+
+//FIX OrdType (40), post-only is a limit order that is rejected instead of taking liquidity
+typedef enum OrderType : char {
+    OrderType_Market = '1',
+    OrderType_Limit = '2',
+    OrderType_PostOnly = 'P',
+} OrderType;
+
+//FIX TimeInForce (59), market orders never rest, Day works like IOC for them
+//GTD rests like Day until the book's logical clock reaches its expiry time
+typedef enum TimeInForce : char {
+    TimeInForce_Day = '0',
+    TimeInForce_IOC = '3',
+    TimeInForce_FOK = '4',
+    TimeInForce_GTD = '6',
+} TimeInForce;
+
+//known type and time in force, post-only only makes sense for an order that rests, GTD only for limit orders
+inline bool ValidOrderType(OrderType type, TimeInForce tif) {
+    bool tifOk = tif == TimeInForce_Day || tif == TimeInForce_IOC || tif == TimeInForce_FOK || tif == TimeInForce_GTD;
+    bool typeOk = type == OrderType_Market || type == OrderType_Limit || type == OrderType_PostOnly;
+    return tifOk && typeOk && (type != OrderType_PostOnly || tif == TimeInForce_Day) && (tif != TimeInForce_GTD || type == OrderType_Limit);
+}
+
+//logical time, only moved by the input stream (the clock command), so replays expire the same orders at the same point
+//the unit is up to the client
+typedef uint32_t Timestamp;
+
+std::string_view OrderStatusName(OrderStatus status);
+
+//cold part of an order: what it was entered or last amended with and its place in the queue, matching never reads it
+struct OrderInfo {
+    double orderPx;         //0 for market orders
+    int orderQty;
+    unsigned seq;           //queue sequence number within the level
+    Timestamp expireTime;   //GTD orders only
+};
+
+//orders only live in OrderPool slabs: OrderSlabSize hot Orders followed by their OrderInfos, aligned to OrderSlabBytes,
+//so an order finds its cold part by address arithmetic instead of a pointer in the hot part
+const size_t OrderSlabSize = 4096;
+const size_t OrderSlabBytes = 1 << 18;
+
+//hot part of an order: everything matching and the level queues touch, two orders per cache line
+struct Order {
+    Order *prev;    //intrusive links of the price level queue, valid while the order rests on a level
+    Order *next;
+    int orderId;
+    int leavesQty;          //orderQty - cumQty, negative once amended below what it got filled
+    Tick orderTick;         //InvalidTick for market orders
+    OrderSide side;
+    OrderStatus status;
+    OrderType type;
+    TimeInForce tif;
+
+    bool IsActive() const {
+        return status == OrderStatus_New || status == OrderStatus_PartiallyFilled;
+    }
+
+    OrderInfo &Info() const {
+        uintptr_t slab = (uintptr_t)this & ~(uintptr_t)(OrderSlabBytes - 1);
+        size_t index = ((uintptr_t)this - slab) / sizeof(Order);
+        return ((OrderInfo *)(slab + OrderSlabSize * sizeof(Order)))[index];
+    }
+
+    int OrderQty() const { return Info().orderQty; }
+    int CumQty() const { return Info().orderQty - leavesQty; }
+    double OrderPx() const { return Info().orderPx; }
+
+    //the filled qty stays, leaves follow the new order qty
+    void SetOrderQty(int orderQty) {
+        OrderInfo &info = Info();
+        leavesQty += orderQty - info.orderQty;
+        info.orderQty = orderQty;
+    }
+
+    std::string_view GetStatusString() const { return OrderStatusName(status); }
+};
+
+static_assert(sizeof(Order) == 32, "hot order data is half a cache line");
+static_assert(OrderSlabSize * (sizeof(Order) + sizeof(OrderInfo)) <= OrderSlabBytes, "slab does not fit");
+
+#endif //ORDERBOOK_ORDER_H
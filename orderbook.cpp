@@ -1,382 +1,680 @@
 
+#include <algorithm>
 #include <vector>
 
-#include <boost/algorithm/string.hpp>
-
 #include "orderbook.h"
+#include "textprotocol.h"
 
 using namespace std;
 
-OrderBook::~OrderBook() {
-    for(auto it: orders) {
-        delete it.second;
+void OrderBook::NewOrder(int orderId, OrderSide side, int orderQty, double orderPx, OrderType type, TimeInForce tif, Timestamp expireTime){
+    Tick orderTick = InvalidTick;
+    if(type != OrderType_Market && !PxToTick(orderPx, orderTick)) {
+        //off the tick table
+        STATS(++stats.rejected);
+        return;
     }
-    orders.clear();
+    AddOrder(orderId, side, orderQty, orderTick, type, tif, expireTime);
 }
 
-void OrderBook::NewOrder(int orderId, OrderSide side, int orderQty, double orderPx){
+void OrderBook::AddOrder(int orderId, OrderSide side, int orderQty, Tick orderTick, OrderType type, TimeInForce tif, Timestamp expireTime){
+    if(side == OrderSide::OrderSide_Buy) {
+        AddOrder<OrderSide::OrderSide_Buy>(orderId, orderQty, orderTick, type, tif, expireTime);
+    } else {
+        AddOrder<OrderSide::OrderSide_Sell>(orderId, orderQty, orderTick, type, tif, expireTime);
+    }
+}
 
-    if(orders.find(orderId) != orders.end()) {
+template<OrderSide Side>
+void OrderBook::AddOrder(int orderId, int orderQty, Tick orderTick, OrderType type, TimeInForce tif, Timestamp expireTime){
+
+    if(orders.Find(orderId)) {
         //https://www.onixs.biz/fix-dictionary/4.2/app_d22.html
         //for this Test Assignment we do nothing ;)
+        STATS(++stats.rejected);
         return;
     }
 
-    if(!ValidatePx(orderPx)) {
+    bool rests = type != OrderType_Market && (tif == TimeInForce_Day || tif == TimeInForce_GTD);
+    if(rests && !Levels<Side>().CanHold(orderTick)) {
+        //too far away from the rest of the book
+        STATS(++stats.rejected);
         return;
     }
 
-    Order *order = new Order();
+    Order *order = pool.Alloc();
 
     order->orderId = orderId;
-    order->side = side;
-    order->orderQty = orderQty;
-    order->cumQty = 0;
-    order->orderPx = orderPx;
+    order->side = Side;
+    order->leavesQty = orderQty;
+    order->orderTick = orderTick;
+    order->type = type;
+    order->tif = tif;
     order->status = OrderStatus_New;
-    orders[orderId] = order;
+    OrderInfo &info = order->Info();
+    info.orderQty = orderQty;
+    info.orderPx = orderTick == InvalidTick? 0: TickToPx(orderTick);
+    info.expireTime = tif == TimeInForce_GTD? expireTime: 0;
+    orders.Insert(orderId, order);
+
+    //post-only must not take liquidity, FOK must not leave a partial fill behind, neither trades speculatively
+    //a GTD order whose time has already come never rests
+    if((type == OrderType_PostOnly && Available<Side>(order, 1)) || (tif == TimeInForce_FOK && Available<Side>(order, orderQty) < orderQty)
+       || (tif == TimeInForce_GTD && expireTime <= expiries.Now())) {
+        STATS(++stats.rejected);
+        order->status = OrderStatus_Rejected;
+        if(events) Report(EventType_Reject, order, orderQty);
+        Retire(order);
+        return;
+    }
 
-    AddToPx(order, orderPx);
-    Match(order);
+    if(rests) {
+        Match<Side>(order);
+        if(tif == TimeInForce_GTD && order->IsActive()) expiries.Schedule(orderId, expireTime);
+        return;
+    }
+
+    //IOC and market orders trade what they can and never show up on a level
+    Sweep<Side>(order);
+    if(order->status == OrderStatus_Filled) {
+        Retire(order);
+        return;
+    }
+    order->status = OrderStatus_Canceled;
+    if(events) Report(EventType_Cancel, order, order->leavesQty);
+    Retire(order);
 }
 
 void OrderBook::AmendOrder(int orderId, int orderQty){
-    if(orders.find(orderId) == orders.end()) {
+    ModifyOrder(orderId, orderQty, InvalidTick);
+}
+
+void OrderBook::AmendOrder(int orderId, int orderQty, double orderPx){
+    Tick orderTick;
+    if(!PxToTick(orderPx, orderTick)) {
+        //off the tick table
+        STATS(++stats.rejected);
+        return;
+    }
+    ModifyOrder(orderId, orderQty, orderTick);
+}
+
+void OrderBook::ModifyOrder(int orderId, int orderQty, Tick orderTick){
+    Order *order = orders.Find(orderId);
+    if(!order) {
         //amend non-existing order
+        STATS(++stats.rejected);
         return;
     }
 
-    Order *order = orders[orderId];
     if(!order->IsActive()) {
         //assumption: we reject amends for non-active orders
+        STATS(++stats.rejected);
         return;
     }
 
-    if(orderQty <= order->cumQty) { //got fully filled -> removing
-        order->orderQty = orderQty;
+    if(order->side == OrderSide::OrderSide_Buy) {
+        ModifyOrder<OrderSide::OrderSide_Buy>(order, orderQty, orderTick);
+    } else {
+        ModifyOrder<OrderSide::OrderSide_Sell>(order, orderQty, orderTick);
+    }
+}
+
+template<OrderSide Side>
+void OrderBook::ModifyOrder(Order *order, int orderQty, Tick orderTick){
+    //pre-condition: order is active and on Side
+    if(orderTick != InvalidTick && orderTick != order->orderTick) {
+        if(!Levels<Side>().CanHold(orderTick)) {
+            //too far away from the rest of the book
+            STATS(++stats.rejected);
+            return;
+        }
+        if(order->type == OrderType_PostOnly && Available<Side>(orderTick, 1)) {
+            //post-only stays passive, the amend is refused and the order keeps resting where it is
+            STATS(++stats.rejected);
+            return;
+        }
+        MoveOrder<Side>(order, orderQty, orderTick);
+        return;
+    }
+
+    int oldQty = order->OrderQty();
+    Levels<Side>().Find(order->orderTick)->qty += orderQty - oldQty;
+    order->SetOrderQty(orderQty);
+
+    if(order->leavesQty <= 0) { //got fully filled -> removing
         order->status = OrderStatus_Filled;
-        Deactivate(order);
+        if(events) Report(EventType_Amend, order, orderQty);
+        Deactivate<Side>(order);
         return;
     }
 
-    if(order->orderQty < orderQty) { //amend up -> lost queue
-        AmendOnPx(order, order->orderPx);
+    //amend down keeps the queue position, only the level aggregate changed
+    if(oldQty < orderQty) { //amend up -> lost queue
+        AmendOnPx<Side>(order, order->orderTick);
     }
-    order->orderQty = orderQty;
+    OnLevelChanged<Side>(order->orderTick);
+    if(events) Report(EventType_Amend, order, orderQty);
+}
 
-    //TODO: for more aggressive price amends we will need Match
-    // Match(order);
+template<OrderSide Side>
+void OrderBook::MoveOrder(Order *order, int orderQty, Tick orderTick) {
+    //pre-condition: order is active, orderTick differs from its price and the ladder can hold it
+    RemoveFromPx<Side>(order, order->orderTick);
+    order->SetOrderQty(orderQty);
+    order->orderTick = orderTick;
+    order->Info().orderPx = TickToPx(orderTick);
+
+    if(order->leavesQty <= 0) {
+        order->status = OrderStatus_Filled;
+        if(events) Report(EventType_Amend, order, orderQty);
+        Retire(order);
+        return;
+    }
+
+    if(events) Report(EventType_Amend, order, orderQty);
+    Match<Side>(order);
 }
 
 void OrderBook::CancelOrder(int orderId) {
-    if(orders.find(orderId) == orders.end()) {
+    Order *order = orders.Find(orderId);
+    if(!order) {
         //cancel non-existing order
+        STATS(++stats.rejected);
         return;
     }
 
-    Order *order = orders[orderId];
     if(!order->IsActive()) {
         //assumption: we reject cancel for non-active orders
+        STATS(++stats.rejected);
         return;
     }
 
-    order->status = OrderStatus_Canceled;
-    Deactivate(order);
+    Cancel(order, OrderStatus_Canceled);
 }
 
-void OrderBook::Match(Order *theOrder) {
+void OrderBook::Cancel(Order *order, OrderStatus status) {
+    order->status = status;
+    if(events) Report(EventType_Cancel, order, order->leavesQty);
+    if(order->side == OrderSide::OrderSide_Buy) {
+        Deactivate<OrderSide::OrderSide_Buy>(order);
+    } else {
+        Deactivate<OrderSide::OrderSide_Sell>(order);
+    }
+}
 
-    int theLeavesQty = theOrder->orderQty - theOrder->cumQty;
-    std::vector<Order *> completed;
-
-    if(theOrder->side == OrderSide::OrderSide_Buy) {
-        for(auto &iter : sellPriceOrders){
-            auto px = iter.first;
-            auto &orders = iter.second;
-            if(px > theOrder->orderPx) break;
-
-            for(auto order: orders) {
-                if(!theLeavesQty) break;
-                int leavesQty = order->orderQty - order->cumQty;
-                if(theLeavesQty >= leavesQty) {
-                    theLeavesQty -= leavesQty;
-                    order->cumQty = order->orderQty;
-                    order->status = OrderStatus_Filled;
-                    completed.push_back(order);
-                } else {
-                    order->cumQty += theLeavesQty;
-                    order->status = OrderStatus_PartiallyFilled;
-                    theLeavesQty = 0;
-                }
+void OrderBook::AdvanceTime(Timestamp time) {
+    if(time < expiries.Now()) {
+        STATS(++stats.rejected);
+        return;
+    }
+    expiries.Advance(time, [this](int orderId, Timestamp expireTime) {
+        //entries stay behind when an order is canceled, filled or recycled, only a live GTD order with this very expiry goes
+        Order *order = orders.Find(orderId);
+        if(!order || !order->IsActive() || order->tif != TimeInForce_GTD || order->Info().expireTime != expireTime) return;
+        Cancel(order, OrderStatus_Expired);
+    });
+}
+
+void OrderBook::MassCancel(const Command &command, Reply &reply) {
+    reply.type = ReplyType_MassCancel;
+    reply.side = command.side;
+    reply.id = 0;
+    reply.qty = reply.count = 0;
+    if(command.side != OrderSide::OrderSide_Sell) MassCancel<OrderSide::OrderSide_Buy>(command.tick, command.lastTick, reply);
+    if(command.side != OrderSide::OrderSide_Buy) MassCancel<OrderSide::OrderSide_Sell>(command.tick, command.lastTick, reply);
+}
+
+void OrderBook::MassAmend(const Command &command, Reply &reply) {
+    reply.type = ReplyType_MassAmend;
+    reply.side = command.side;
+    reply.id = 0;
+    reply.qty = reply.count = 0;
+    if(command.side == OrderSide::OrderSide_Buy) {
+        MassAmend<OrderSide::OrderSide_Buy>(command.tick, command.lastTick, command.qty, reply);
+    } else {
+        MassAmend<OrderSide::OrderSide_Sell>(command.tick, command.lastTick, command.qty, reply);
+    }
+}
+
+template<OrderSide Side, typename F>
+void OrderBook::ForEachLevelIn(Tick first, Tick last, F f) {
+    auto &levels = Levels<Side>();
+    //the walk starts at the best end of the range and stops behind its worst end
+    Tick from = Side == OrderSide::OrderSide_Buy? last: first;
+    Tick to = Side == OrderSide::OrderSide_Buy? first: last;
+    Tick px = from == InvalidTick? levels.BestTick(): levels.Find(from)? from: levels.NextTick(from);
+    while(px != InvalidTick && (to == InvalidTick || !levels.Better(to, px))) {
+        Tick next = levels.NextTick(px);
+        f(px);
+        px = next;
+    }
+}
+
+template<OrderSide Side>
+void OrderBook::MassCancel(Tick first, Tick last, Reply &reply) {
+    auto &levels = Levels<Side>();
+    ForEachLevelIn<Side>(first, last, [&](Tick px) {
+        PriceLevel *level = levels.Find(px);
+        reply.qty += level->qty;
+        reply.count += level->count;
+        for(Order *order = level->head; order; order = order->next) {
+            order->status = OrderStatus_Canceled;
+            if(events) Report(EventType_Cancel, order, order->leavesQty);
+        }
+        //the level goes as a whole, Retire relinks the order, so step ahead first
+        for(Order *order = levels.TakeAll(px), *next; order; order = next) {
+            next = order->next;
+            Retire(order);
+        }
+        OnLevelChanged<Side>(px);
+    });
+}
+
+template<OrderSide Side>
+void OrderBook::MassAmend(Tick first, Tick last, int orderQty, Reply &reply) {
+    auto &levels = Levels<Side>();
+    ForEachLevelIn<Side>(first, last, [&](Tick px) {
+        //same rules as a single amend: down keeps the queue position, up goes to the back, below the filled qty finishes it
+        //orders sent to the back land behind the old tail, so the walk stops there and sees every order once
+        PriceLevel *level = levels.Find(px);
+        Order *tail = level->tail;
+        for(Order *order = level->head, *next; order; order = next) {
+            next = order == tail? NULL: order->next;
+            int oldQty = order->OrderQty();
+            level->qty += orderQty - oldQty;
+            order->SetOrderQty(orderQty);
+            ++reply.count;
+            if(order->leavesQty <= 0) {
+                order->status = OrderStatus_Filled;
+                if(events) Report(EventType_Amend, order, orderQty);
+                levels.Remove(order, px);
+                Retire(order);
+                continue;
             }
+            if(oldQty < orderQty) levels.MoveToBack(order, px);
+            reply.qty += order->leavesQty;
+            if(events) Report(EventType_Amend, order, orderQty);
         }
-    } else {
-        for(auto &iter : buyPriceOrders){
-            auto px = iter.first;
-            auto &orders = iter.second;
-            if(px < theOrder->orderPx) break;
-
-            for(auto order: orders) {
-                if(!theLeavesQty) break;
-                int leavesQty = order->orderQty - order->cumQty;
-                if(theLeavesQty >= leavesQty) {
-                    theLeavesQty -= leavesQty;
-                    order->cumQty = order->orderQty;
-                    order->status = OrderStatus_Filled;
-                    completed.push_back(order);
-                } else {
-                    order->cumQty += theLeavesQty;
-                    order->status = OrderStatus_PartiallyFilled;
-                    theLeavesQty = 0;
-                }
+        OnLevelChanged<Side>(px);
+    });
+}
+
+template<OrderSide Side>
+int OrderBook::Available(Tick limit, int qty) {
+    auto &levels = Levels<Opposite(Side)>();
+    int available = 0;
+    for(Tick px = levels.BestTick(); px != InvalidTick && available < qty; px = levels.NextTick(px)) {
+        if(!levels.Crosses(px, limit)) break;
+        available += levels.Find(px)->qty;
+    }
+    return min(available, qty);
+}
+
+template<OrderSide Side>
+int OrderBook::Sweep(Order *theOrder) {
+
+    int theLeavesQty = theOrder->leavesQty;
+    Tick limit = LimitTick<Side>(theOrder);
+
+    constexpr OrderSide OtherSide = Opposite(Side);
+    auto &levels = Levels<OtherSide>();
+    STATS(int levelsTouched = 0);
+    //every crossed level is either consumed whole, which makes the next one the best, or is the last one
+    while(theLeavesQty) {
+        Tick px = levels.BestTick();
+        if(px == InvalidTick || !levels.Crosses(px, limit)) break;
+        STATS(++levelsTouched);
+
+        PriceLevel *level = levels.Find(px);
+        if(theLeavesQty >= level->qty) {
+            //each fill reports the aggressor's leaves as they stand after that fill, not after the whole level
+            for(Order *order = level->head; order; order = order->next) {
+                int leavesQty = order->leavesQty;
+                theLeavesQty -= leavesQty;
+                order->leavesQty = 0;
+                order->status = OrderStatus_Filled;
+                STATS(++stats.fills);
+                if(events) ReportFill(theOrder, order, leavesQty, theLeavesQty);
+            }
+            //Retire relinks the order, so step ahead first
+            for(Order *order = levels.TakeAll(px), *next; order; order = next) {
+                next = order->next;
+                Retire(order);
             }
+            OnLevelChanged<OtherSide>(px);
+            continue;
         }
+
+        //the level outlives the order: filled orders leave from the front, one may be partially filled
+        //they are taken off before the level is published so depth consumers never see qty and count disagree
+        while(theLeavesQty) {
+            Order *order = level->head;
+            int leavesQty = order->leavesQty;
+            if(theLeavesQty >= leavesQty) {
+                theLeavesQty -= leavesQty;
+                levels.PopFront(px);
+                order->leavesQty = 0;
+                order->status = OrderStatus_Filled;
+                STATS(++stats.fills);
+                if(events) ReportFill(theOrder, order, leavesQty, theLeavesQty);
+                Retire(order);
+            } else {
+                order->leavesQty -= theLeavesQty;
+                level->qty -= theLeavesQty;
+                order->status = OrderStatus_PartiallyFilled;
+                STATS(++stats.fills);
+                if(events) ReportFill(theOrder, order, theLeavesQty, 0);
+                theLeavesQty = 0;
+            }
+        }
+        OnLevelChanged<OtherSide>(px);
     }
 
-    theOrder->cumQty = theOrder->orderQty - theLeavesQty;
-    if(theOrder->cumQty == theOrder->orderQty) {
+    STATS(if(levelsTouched) stats.levelsPerMatch.Add(levelsTouched));
+    int filledQty = theOrder->leavesQty - theLeavesQty;
+    theOrder->leavesQty = theLeavesQty;
+    if(!theLeavesQty) {
         theOrder->status = OrderStatus_Filled;
-        completed.push_back(theOrder);
-    } else if(theOrder->cumQty > 0) {
+    } else if(filledQty) {
         theOrder->status = OrderStatus_PartiallyFilled;
     }
-    for(auto order: completed) {
-        Deactivate(order);
+    return filledQty;
+}
+
+template<OrderSide Side>
+void OrderBook::Match(Order *theOrder) {
+    //pre-condition: theOrder is on no level, the ladder can hold its price
+    //it trades before it is placed, so depth consumers never see it as a level crossing the opposite side
+    Sweep<Side>(theOrder);
+    if(theOrder->status == OrderStatus_Filled) {
+        Retire(theOrder);
+        return;
     }
+    AddToPx<Side>(theOrder, theOrder->orderTick);
 }
 
+void OrderBook::Report(EventType type, Order *order, int qty) {
+    Event event;
+    event.type = type;
+    event.status = order->status;
+    event.aggressorStatus = order->status;
+    event.orderId = order->orderId;
+    event.restingId = 0;
+    event.qty = qty;
+    event.tick = order->orderTick;
+    events->Push(event);
+}
+
+void OrderBook::ReportFill(Order *aggressor, Order *resting, int qty, int aggressorLeavesQty) {
+    Event event;
+    event.type = EventType_Fill;
+    event.status = resting->status;
+    event.aggressorStatus = aggressorLeavesQty? OrderStatus_PartiallyFilled: OrderStatus_Filled;
+    event.orderId = aggressor->orderId;
+    event.restingId = resting->orderId;
+    event.qty = qty;
+    event.tick = resting->orderTick;
+    events->Push(event);
+}
+
+template<OrderSide Side>
 void OrderBook::Deactivate(Order *order) {
-    RemoveFromPx(order, order->orderPx);
+    RemoveFromPx<Side>(order, order->orderTick);
+    Retire(order);
+}
+
+void OrderBook::Retire(Order *order) {
+    //pre-condition: order is finished and off the levels, its links are free
+    order->prev = retiredTail;
+    order->next = NULL;
+    if(retiredTail) retiredTail->next = order; else retiredHead = order;
+    retiredTail = order;
+
+    if(++retiredCount <= retainedOrders) return;
+
+    Order *oldest = retiredHead;
+    retiredHead = oldest->next;
+    if(retiredHead) retiredHead->prev = NULL; else retiredTail = NULL;
+    --retiredCount;
+    orders.Erase(oldest->orderId);
+    pool.Free(oldest);
 }
 
-void OrderBook::AddToPx(Order *order, double px){
+template<OrderSide Side>
+void OrderBook::AddToPx(Order *order, Tick px){
     //pre-condition: order must not be on this px
-    if(order->side == OrderSide::OrderSide_Buy) {
-        if(buyPriceOrders.find(px) == buyPriceOrders.end())
-            buyPriceOrders[px] = std::list<Order *>();
-        buyPriceOrders[px].push_back(order);
-    } else {
-        if (sellPriceOrders.find(order->orderPx) == sellPriceOrders.end())
-            sellPriceOrders[order->orderPx] = std::list<Order *>();
-        sellPriceOrders[order->orderPx].push_back(order);
-    }
+    Levels<Side>().Push(order, px);
+    OnLevelChanged<Side>(px);
 }
 
-void OrderBook::AmendOnPx(Order *order, double px){
+template<OrderSide Side>
+void OrderBook::AmendOnPx(Order *order, Tick px){
     //pre-condition: order must be on this px
-    if(order->side == OrderSide::OrderSide_Buy) {
-        auto &priceOrders = buyPriceOrders[px];
-        priceOrders.remove(order);
-        priceOrders.push_back(order);
-    } else {
-        auto &priceOrders = sellPriceOrders[px];
-        priceOrders.remove(order);
-        priceOrders.push_back(order);
-    }
+    Levels<Side>().MoveToBack(order, px);
 }
 
-void OrderBook::RemoveFromPx(Order *order, double px) {
+template<OrderSide Side>
+void OrderBook::RemoveFromPx(Order *order, Tick px) {
     //pre-condition: order must be on this px already
-    if(order->side == OrderSide::OrderSide_Buy) {
-        auto &priceOrders = buyPriceOrders[px];
-        priceOrders.remove(order);
-        if(!priceOrders.size())
-            buyPriceOrders.erase(px);
-    }
-    else {
-        auto &priceOrders = sellPriceOrders[px];
-        priceOrders.remove(order);
-        if(!priceOrders.size())
-            sellPriceOrders.erase(px);
+    Levels<Side>().Remove(order, px);
+    OnLevelChanged<Side>(px);
+}
+
+bool OrderBook::FindLevel(OrderSide side, int level, DepthEntry &entry) {
+    auto &depth = GetDepth(side);
+    if(level < 0) return false;
+    if(level < depth.Size()) {
+        entry = depth[level];
+        return true;
     }
+    if(depth.Complete()) return false;
+
+    //deeper than the cache, walk on from its last level
+    Tick px = depth[depth.Size() - 1].tick;
+    PriceLevel *info = WithLevels(side, [&](auto &levels) -> PriceLevel * {
+        for (int i = depth.Size() - 1; i < level && px != InvalidTick; ++i) {
+            px = levels.NextTick(px);
+        }
+        return px == InvalidTick? NULL: levels.Find(px);
+    });
+    if(!info) return false;
+
+    entry.tick = px;
+    entry.qty = info->qty;
+    entry.count = info->count;
+    return true;
 }
 
 std::tuple<double, int, int> OrderBook::GetLevel(OrderSide side, int level) {
-    int i = 0;
-    list < Order * > orders;
-    double px = 0;
-    if (side == OrderSide::OrderSide_Sell) {
-        auto it = sellPriceOrders.begin();
-        for (; i < level && it != sellPriceOrders.end(); ++i, ++it) {}
-        if (i == level && it != sellPriceOrders.end()) {
-            px = it->first;
-            orders = it->second;
-        }
-    } else {
-        auto it = buyPriceOrders.begin();
-        for (; i < level && it != buyPriceOrders.end(); ++i, ++it) {}
-        if (i == level && it != buyPriceOrders.end()) {
-            px = it->first;
-            orders = it->second;
-        }
-    }
-    if(orders.size() == 0) return tuple<double, int, int>(0, 0, 0);
+    DepthEntry entry;
+    if(!FindLevel(side, level, entry)) return tuple<double, int, int>(0, 0, 0);
 
-    int qty = 0;
-    int count = 0;
-    for(Order * order: orders) {
-        qty += order->orderQty - order->cumQty;
-        ++count;
-    }
-    return tuple<double, int, int>(px, qty, count);
+    return tuple<double, int, int>(TickToPx(entry.tick), entry.qty, entry.count);
 }
 
 int OrderBook::GetPosition(Order *theOrder){
 
     if(!theOrder->IsActive()) return -1;
 
-    list<Order *> orders;
-    if(theOrder->side == OrderSide::OrderSide_Buy) {
-        orders = buyPriceOrders[theOrder->orderPx];
-    } else {
-        orders = sellPriceOrders[theOrder->orderPx];
-    }
-    int pos = 0;
-    for(Order *order: orders) {
-        if(order == theOrder) break;
-        ++pos;
-    }
-    return pos == orders.size()? -1: pos;
+    PriceLevel *level = WithLevels(theOrder->side, [theOrder](auto &levels) { return levels.Find(theOrder->orderTick); });
+    int renumbered;
+    int position = level->Position(theOrder, renumbered);
+    STATS(if(renumbered) stats.positionRenumber.Add(renumbered));
+    return position;
 }
 
 
 void OrderBook::Print(std::ostream &stream) {
     stream << "Bid/Ask: " <<endl;
-    int count = 0;
-    for(auto &it: buyPriceOrders){
-        if(++count > 5) break;
-        double px = it.first;
-        int qty = 0;
-        for(Order *order: it.second){
-            qty += order->orderQty - order->cumQty;
-        }
-        stream << "Bid " << count << ": px=" << px << ", qty=" << qty <<endl;
-    }
-    count = 0;
-    for(auto &it: sellPriceOrders){
-        if(++count > 5) break;
-        double px = it.first;
-        int qty = 0;
-        for(Order *order: it.second){
-            qty += order->orderQty - order->cumQty;
-        }
-        stream << "Ask " << count << ": px=" << px << ", qty=" << qty <<endl;
+    for(int i = 0; i < buyDepth.Size() && i < 5; ++i){
+        stream << "Bid " << i + 1 << ": px=" << TickToPx(buyDepth[i].tick) << ", qty=" << buyDepth[i].qty <<endl;
+    }
+    for(int i = 0; i < sellDepth.Size() && i < 5; ++i){
+        stream << "Ask " << i + 1 << ": px=" << TickToPx(sellDepth[i].tick) << ", qty=" << sellDepth[i].qty <<endl;
     }
 
     stream << "Orders: " <<endl;
-    for(auto it: orders) {
-        Order *order = it.second;
+    std::vector<Order *> all;
+    all.reserve(orders.Size());
+    orders.ForEach([&all](Order *order) { all.push_back(order); });
+    std::sort(all.begin(), all.end(), [](Order *a, Order *b) { return a->orderId < b->orderId; });
+    for(Order *order: all) {
         stream << "orderId=" << order->orderId
-                << ", px=" << order->orderPx
-                << ", qty=" << order->orderQty
-                << ", cumQty=" << order->cumQty
+                << ", px=" << order->OrderPx()
+                << ", qty=" << order->OrderQty()
+                << ", cumQty=" << order->CumQty()
                 << ", status=" << order->GetStatusString()
                 <<endl;
     }
 
 }
 
-class InvalidException : public std::exception {
-};
-
-void OrderBook::ProcessMessage(const std::string &message, std::ostream &output ) {
-    try {
-
-        std::deque<std::string> tokens;
-        boost::split(tokens, message, boost::is_any_of(" "));
-        if (tokens.size() < 1) throw InvalidException();
+void OrderBook::AppendStats(OutputBuffer &output) const {
+#ifdef ORDERBOOK_STATS
+    FormatStats(stats, output);
+#else
+    output.Append("stats, disabled\n");
+#endif
+}
 
-        string messageType = tokens[0];
-        if(messageType == "order") {
-            //order 1001 buy 100 12.30
-            if (tokens.size() < 5) throw InvalidException();
-            int orderId = std::stoi(tokens[1]);
-            std::string strSide = tokens[2];
-            OrderSide side;
-            if(strSide == "buy") {
-                side = OrderSide::OrderSide_Buy;
-            } else if(strSide == "sell") {
-                side = OrderSide::OrderSide_Sell;
-            } else {
-                throw InvalidException();
-            }
-            int orderQty = std::stoi(tokens[3]);
-            double orderPx = std::stod(tokens[4]);
-
-            if (orderId < 0 || orderQty <= 0 || orderPx <= 0)
-                throw InvalidException();
-
-            NewOrder(orderId, side, orderQty, orderPx);
-        } else if(messageType == "amend") {
-            //M,100007,S,4,1025
-            //amend 1004 600
-            if (tokens.size() < 3) throw InvalidException();
-            int orderId = std::stoi(tokens[1]);
-            int orderQty = std::stoi(tokens[2]);
-
-            if (orderId < 0 || orderQty <= 0) throw InvalidException();
-
-            AmendOrder(orderId, orderQty);
-        } else if(messageType == "cancel") {
-            //cancel 1003
-            if (tokens.size() < 2) throw InvalidException();
-            int orderId = std::stoi(tokens[1]);
-            if (orderId < 0) throw InvalidException();
-
-            CancelOrder(orderId);
-        } else if(messageType == "q") {
-            if (tokens.size() < 2) throw InvalidException();
-            string subType = tokens[1];
-            if(subType == "level") {
-                if (tokens.size() < 4) throw InvalidException();
-                string subsubType = tokens[2];
-                int level = std::stoi(tokens[3]);
-                if(subsubType == "ask") {
-                    auto info = GetLevel(OrderSide::OrderSide_Sell, level);
-                    output << "ask, " << level << ", " << std::get<0>(info) << ", " << std::get<1>(info) << ", " << std::get<2>(info) << endl;
-                } else if(subsubType == "bid") {
-                    auto info = GetLevel(OrderSide::OrderSide_Buy, level);
-                    output << "bid, " << level << ", " << std::get<0>(info) << ", " << std::get<1>(info) << ", " << std::get<2>(info) << endl;
-                } else {
-                    throw InvalidException();
-                }
-            } else if(subType == "order") {
-                if (tokens.size() < 3) throw InvalidException();
-                int orderId = std::stoi(tokens[2]);
-                Order *order = GetOrder(orderId);
-                if(order != nullptr) {
-                    output << "order, " << orderId << ", " << order->GetStatusString() << ", " <<
-                    order->orderQty - order->cumQty << ", " << GetPosition(order) << endl;
-                } else {
-                    output << "order, " << orderId << " " << "Not found" << endl;
-                }
-            } else {
-                throw InvalidException();
-            }
-        } else {
-            throw InvalidException();
-        }
+void OrderBook::ProcessMessage(std::string_view message, std::ostream &output) {
+    replyBuffer.Clear();
+    ProcessMessage(message, replyBuffer);
+    output.write(replyBuffer.Data(), replyBuffer.Size());
+}
 
+void OrderBook::ProcessMessage(std::string_view message, OutputBuffer &output) {
+    STATS(uint64_t start = ReadTsc());
+    Command command;
+    if(ParseMessage(message, command) != ParseError_None) {
+        STATS(++stats.invalid);
+        FormatInvalid(message, output);
+        return;
     }
+    if(command.type == CommandType_QueryStats) {
+        AppendStats(output);
+        return;
+    }
+    if(command.type == CommandType_Snapshot) {
+        SaveSnapshot();
+        return;
+    }
+    STATS(StageStats &stages = stats.ForType(command.type));
+    STATS(stages.parse.Add(ReadTsc() - start));
+    Reply reply;
+    if(Execute(command, reply)) {
+        STATS(uint64_t executed = ReadTsc());
+        FormatReply(reply, output);
+        STATS(stages.output.Add(ReadTsc() - executed));
+    }
+}
 
-    catch (...) { //InvalidException, std::invalid_argument, std::out_of_range
-        output << "Got Invalid Message: " << message << endl;
+bool OrderBook::Execute(const Command &command, Reply &reply) {
+    STATS(uint64_t start = ReadTsc());
+    bool hasReply = Dispatch(command, reply);
+    //readers see the book between commands, never half way through a match
+    if(view && viewChanged) {
+        view->Publish(buyDepth, sellDepth);
+        viewChanged = false;
     }
+    STATS(++stats.messages);
+    STATS(stats.ForType(command.type).match.Add(ReadTsc() - start));
+    return hasReply;
 }
 
- bool OrderBook::ValidatePx(double px) {
-    //TODO: add logic for validation of tick size
-    // for this Test Assignment we always return true
-    // the exact logic depends always exchange
-    // for example for SGX Stocks, REITs, business trusts, company warrants
-    // Price Below 0.20 -> 0.001
-    // Price 0.20 – 1.995 -> 0.005
-    // Price 2.00 and above -> 0.01
+size_t OrderBook::ExecuteBatch(const Command *commands, size_t count, Reply *replies) {
+    for(size_t i = 0; i < count && i < PrefetchFar; ++i) PrefetchSlot(commands[i]);
+    size_t replied = 0;
+    STATS(uint64_t start = ReadTsc());
+    for(size_t i = 0; i < count; ++i) {
+        if(i + PrefetchFar < count) PrefetchSlot(commands[i + PrefetchFar]);
+        if(i + PrefetchNear < count) PrefetchOrder(commands[i + PrefetchNear]);
+        replies[i].type = ReplyType_None;
+        if(Dispatch(commands[i], replies[i])) ++replied;
+        STATS(++stats.messages);
+        STATS(uint64_t end = ReadTsc());
+        STATS(stats.ForType(commands[i].type).match.Add(end - start));
+        STATS(start = end);
+    }
+    //readers see the book between batches, never half way through one
+    if(view && viewChanged) {
+        view->Publish(buyDepth, sellDepth);
+        viewChanged = false;
+    }
+    return replied;
+}
 
+bool OrderBook::Dispatch(const Command &command, Reply &reply) {
+    if(Apply(command, reply)) return HasReply(command.type);
+    //unknown type, or a command the journal could not record
+    reply.type = ReplyType_Invalid;
+    reply.id = command.orderId;
     return true;
 }
 
-std::string Order::GetStatusString() {
+bool OrderBook::Apply(const Command &command, Reply &reply) {
+    switch(command.type) {
+        case CommandType_NewOrder:
+            if(journal && !journal->Append(command)) break;
+            AddOrder(command.orderId, command.side, command.qty, command.tick, command.orderType, command.tif, command.time);
+            return true;
+        case CommandType_Amend:
+            if(journal && !journal->Append(command)) break;
+            ModifyOrder(command.orderId, command.qty, command.tick);
+            return true;
+        case CommandType_Cancel:
+            if(journal && !journal->Append(command)) break;
+            CancelOrder(command.orderId);
+            return true;
+        case CommandType_QueryLevel: {
+            DepthEntry entry;
+            bool found = FindLevel(command.side, command.qty, entry);
+            reply.type = ReplyType_Level;
+            reply.side = command.side;
+            reply.id = command.qty;
+            reply.tick = found? entry.tick: InvalidTick;
+            reply.qty = found? entry.qty: 0;
+            reply.count = found? entry.count: 0;
+            return true;
+        }
+        case CommandType_QueryOrder: {
+            Order *order = GetOrder(command.orderId);
+            reply.id = command.orderId;
+            if(order != nullptr) {
+                reply.type = ReplyType_Order;
+                reply.status = order->status;
+                reply.qty = order->leavesQty;
+                reply.count = GetPosition(order);
+            } else {
+                reply.type = ReplyType_OrderNotFound;
+            }
+            return true;
+        }
+        case CommandType_MassCancel:
+            if(journal && !journal->Append(command)) break;
+            MassCancel(command, reply);
+            return true;
+        case CommandType_MassAmend:
+            if(journal && !journal->Append(command)) break;
+            MassAmend(command, reply);
+            return true;
+        case CommandType_Clock:
+            if(journal && !journal->Append(command)) break;
+            AdvanceTime(command.time);
+            return true;
+        case CommandType_QueryStats:
+            reply.type = ReplyType_Stats;
+            reply.id = 0;
+            return true;
+        case CommandType_Snapshot:
+            //text only, see ProcessMessage
+            return true;
+    }
+    return false;
+}
+
+std::string_view OrderStatusName(OrderStatus status) {
     switch (status) {
         case OrderStatus_New:
             return "New";
@@ -388,8 +686,9 @@ std::string Order::GetStatusString() {
             return "Canceled";
         case OrderStatus_Rejected:
             return "Rejected";
+        case OrderStatus_Expired:
+            return "Expired";
         default:
             return "Unknown";
     }
 }
-
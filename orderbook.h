@@ -1,76 +1,268 @@
 #ifndef ORDERBOOK_ORDERBOOK_H
 #define ORDERBOOK_ORDERBOOK_H
 
-#include <string>
-#include <list>
-#include <map>
-
-typedef enum OrderSide {
-    OrderSide_Buy = 'B',
-    OrderSide_Sell = 'S',
-} Side;
-
-typedef enum OrderStatus {
-    OrderStatus_New = '0',
-    OrderStatus_PartiallyFilled = '1',
-    OrderStatus_Filled = '2',
-    OrderStatus_Canceled = '4',
-    OrderStatus_Rejected = '8',
-} OrderStatus;
-
-struct Order {
-    int orderId;
-    OrderSide side;
-    OrderStatus status;
-    int orderQty;
-    int cumQty;
-    double orderPx;
-
-    bool IsActive() {
-        return status == OrderStatus_New || status == OrderStatus_PartiallyFilled;
-    }
+#include <limits>
+#include <ostream>
+#include <string_view>
+#include <tuple>
 
-    std::string GetStatusString();
-};
+#include "bookview.h"
+#include "command.h"
+#include "depthcache.h"
+#include "events.h"
+#include "journal.h"
+#include "marketdata.h"
+#include "order.h"
+#include "orderindex.h"
+#include "orderpool.h"
+#include "outputbuffer.h"
+#include "priceladder.h"
+#include "stats.h"
+#include "timerwheel.h"
 
 class OrderBook {
 
 public:
-    OrderBook() {}
-    ~OrderBook();
+    //number of filled/canceled orders kept queryable before their slots are recycled, oldest go first
+    static const size_t DefaultRetainedOrders = 1 << 20;
+
+    explicit OrderBook(size_t retainedOrders = DefaultRetainedOrders):
+        retainedOrders(retainedOrders) {}
 
-    void NewOrder(int orderId, OrderSide side, int orderQty, double orderPx);
+    //orderPx is ignored for market orders, expireTime is only used by GTD orders
+    void NewOrder(int orderId, OrderSide side, int orderQty, double orderPx,
+                  OrderType type = OrderType_Limit, TimeInForce tif = TimeInForce_Day, Timestamp expireTime = 0);
     void AmendOrder(int orderId, int orderQty);
+    //cancel/replace: a new price moves the order to the back of that level and matches it if it crosses
+    void AmendOrder(int orderId, int orderQty, double orderPx);
     void CancelOrder(int orderId);
 
+    //moves the logical clock to time and expires every GTD order due by then, oldest expiry first
+    //the clock never goes back, an earlier time is rejected
+    void AdvanceTime(Timestamp time);
+    Timestamp Now() const { return expiries.Now(); }
+
     Order *GetOrder(int orderId) {
-        auto it = orders.find(orderId);
-        return it == orders.end()? NULL: it->second;
+        return orders.Find(orderId);
     }
 
     //this function is not-optimized, its for Test assignment only
     //it is not on critical path of real-life order book
-    //in real-life all we need is the top of buyPriceOrders & sellPriceOrders
+    //in real-life all we need is the top of buyLevels & sellLevels
     std::tuple<double, int, int> GetLevel(OrderSide side, int level);
 
-    void ProcessMessage(const std::string &message, std::ostream &output);
+    //top DepthCache::Levels levels, maintained on every book change
+    const DepthCache &GetDepth(OrderSide side) const {
+        return side == OrderSide::OrderSide_Buy? buyDepth: sellDepth;
+    }
+
+    //f(Tick px, int qty, int count) for every level of the side, best first
+    template<typename F>
+    void ForEachLevel(OrderSide side, F f) {
+        WithLevels(side, [&f](auto &levels) {
+            for(Tick px = levels.BestTick(); px != InvalidTick; px = levels.NextTick(px)) {
+                PriceLevel *level = levels.Find(px);
+                f(px, level->qty, level->count);
+            }
+        });
+    }
+
+    //parses and executes one text message, replies (if any) are appended to output
+    void ProcessMessage(std::string_view message, OutputBuffer &output);
+    void ProcessMessage(std::string_view message, std::ostream &output);
+
+    //fills, amends and cancels are pushed to events as they happen, NULL (default) turns reporting off
+    void SetEventBuffer(EventBuffer *events) { this->events = events; }
+
+    //every level change is pushed to marketData as a depth update, NULL (default) turns publishing off
+    void SetMarketDataPublisher(MarketDataPublisher *marketData) { this->marketData = marketData; }
+
+    //commands that change the book are appended to journal before Execute/ProcessMessage run them, NULL (default) turns journaling off
+    //a command the journal can't record (see Journal::Append) is answered as invalid and not run, replay could not repeat it
+    void SetJournal(Journal *journal) { this->journal = journal; }
+
+    //writes the complete book (resting queues and retained finished orders) to path, replacing it atomically
+    //the journal, if any, is synced first and its record count stored, so recovery replays only what follows
+    bool SaveSnapshot(const char *path);
+    //pre-condition: the book is empty and nothing is attached yet
+    //journalRecords: number of journal records already reflected in the snapshot
+    bool LoadSnapshot(const char *path, uint64_t &journalRecords);
+
+    //the text message "snapshot" saves to path, NULL (default) ignores it
+    void SetSnapshotFile(const char *path) { snapshotFile = path; }
+    //what the "snapshot" message does, false if there is no snapshot file or the save failed
+    bool SaveSnapshot() { return snapshotFile && SaveSnapshot(snapshotFile); }
+
+    //the top levels are published to view after every command run through Execute/ProcessMessage that changed them
+    //NULL (default) turns publishing off
+    void SetBookView(BookViewPublisher *view) {
+        this->view = view;
+        if(view) view->Publish(buyDepth, sellDepth);
+    }
+
+    //executes a decoded command, returns true if it produced a reply: HasReply(command.type), or an invalid reply
+    bool Execute(const Command &command, Reply &reply);
+
+    //executes commands[0 .. count) in order, replies[i] answers commands[i] (type ReplyType_None if it has no reply)
+    //the index slots, orders and price levels of the commands a few places ahead are prefetched while the current one runs,
+    //the view is published once per batch; returns the number of replies
+    size_t ExecuteBatch(const Command *commands, size_t count, Reply *replies);
+
+#ifdef ORDERBOOK_STATS
+    //counters and latency histograms, only built with ORDERBOOK_STATS, the book carries none of it otherwise
+    const BookStats &GetStats() const { return stats; }
+#endif
+    //the text answer to a stats query, call it from the thread that runs the book
+    void AppendStats(OutputBuffer &output) const;
+
     void Print(std::ostream &stream);
 
 private:
 
-    static bool ValidatePx(double px);
     int GetPosition(Order *order);
+    bool FindLevel(OrderSide side, int level, DepthEntry &entry);
+
+    //the entry points resolve the side once and hand over to the Side instance, below which nothing branches on it
+    void AddOrder(int orderId, OrderSide side, int orderQty, Tick orderTick, OrderType type, TimeInForce tif, Timestamp expireTime);
+    void ModifyOrder(int orderId, int orderQty, Tick orderTick);
+    template<OrderSide Side> void AddOrder(int orderId, int orderQty, Tick orderTick, OrderType type, TimeInForce tif, Timestamp expireTime);
+    template<OrderSide Side> void ModifyOrder(Order *order, int orderQty, Tick orderTick);
+    template<OrderSide Side> void MoveOrder(Order *order, int orderQty, Tick orderTick);
+    bool Dispatch(const Command &command, Reply &reply);
+    //runs the command, false if it is of no known type or the journal could not record it
+    bool Apply(const Command &command, Reply &reply);
+
+    //mass commands walk the levels of the range once, best first, and add up what they did in reply
+    //first/last: inclusive price range, InvalidTick for the whole side
+    void MassCancel(const Command &command, Reply &reply);
+    void MassAmend(const Command &command, Reply &reply);
+    template<OrderSide Side> void MassCancel(Tick first, Tick last, Reply &reply);
+    template<OrderSide Side> void MassAmend(Tick first, Tick last, int orderQty, Reply &reply);
+    //f(px) for every non-empty level of Side within first..last, f may empty the level
+    template<OrderSide Side, typename F> void ForEachLevelIn(Tick first, Tick last, F f);
+
+    template<OrderSide Side>
+    PriceLadder<Side> &Levels() {
+        if constexpr(Side == OrderSide::OrderSide_Buy) return buyLevels; else return sellLevels;
+    }
+
+    template<OrderSide Side>
+    DepthCache &Depth() {
+        if constexpr(Side == OrderSide::OrderSide_Buy) return buyDepth; else return sellDepth;
+    }
+
+    //f(ladder) with the ladder of a side only known at runtime, f is instantiated for both
+    template<typename F>
+    decltype(auto) WithLevels(OrderSide side, F &&f) {
+        if(side == OrderSide::OrderSide_Buy) return f(buyLevels);
+        return f(sellLevels);
+    }
+
+    template<OrderSide Side>
+    void OnLevelChanged(Tick px) {
+        auto &levels = Levels<Side>();
+        if(Depth<Side>().Update(levels, px)) viewChanged = true;
+        if(marketData) {
+            PriceLevel *level = levels.Find(px);
+            marketData->OnLevel(Side, px, level? level->qty: 0, level? level->count: 0);
+        }
+    }
+
+    void OnLevelChanged(OrderSide side, Tick px) {
+        if(side == OrderSide::OrderSide_Buy) OnLevelChanged<OrderSide::OrderSide_Buy>(px); else OnLevelChanged<OrderSide::OrderSide_Sell>(px);
+    }
+
+    //ExecuteBatch runs two prefetch stages ahead of the command it executes:
+    //PrefetchFar commands ahead the index slot (and the level a new order goes to) starts loading,
+    //PrefetchNear commands ahead that slot is in cache, so the order it points to can be looked up and loaded
+    static const size_t PrefetchFar = 8;
+    static const size_t PrefetchNear = 3;
+
+    void PrefetchSlot(const Command &command) {
+        switch(command.type) {
+            case CommandType_NewOrder:
+                orders.Prefetch(command.orderId);
+                if(command.tick != InvalidTick) WithLevels(command.side, [&command](auto &levels) { levels.Prefetch(command.tick); });
+                break;
+            case CommandType_Amend:
+            case CommandType_Cancel:
+            case CommandType_QueryOrder:
+                orders.Prefetch(command.orderId);
+                break;
+            case CommandType_QueryLevel:
+            case CommandType_QueryStats:
+            case CommandType_Snapshot:
+            case CommandType_MassCancel:
+            case CommandType_MassAmend:
+            case CommandType_Clock:
+                break;
+        }
+    }
+
+    void PrefetchOrder(const Command &command) {
+        if(command.type != CommandType_Amend && command.type != CommandType_Cancel && command.type != CommandType_QueryOrder) return;
+        Order *order = orders.Find(command.orderId);
+        if(!order) return;
+        __builtin_prefetch(order);
+        //amends and queue positions read the cold part as well
+        if(command.type != CommandType_Cancel) __builtin_prefetch(&order->Info());
+    }
+
+    static constexpr OrderSide Opposite(OrderSide side) {
+        return side == OrderSide::OrderSide_Buy? OrderSide::OrderSide_Sell: OrderSide::OrderSide_Buy;
+    }
+
+    //worst price an order on Side trades at, market orders take any price
+    template<OrderSide Side>
+    static Tick LimitTick(const Order *theOrder) {
+        if(theOrder->type != OrderType_Market) return theOrder->orderTick;
+        if constexpr(Side == OrderSide::OrderSide_Buy) return std::numeric_limits<Tick>::max();
+        return std::numeric_limits<Tick>::min();
+    }
+
+    //opposite qty an order on Side limited at limit could trade right now, counted up to qty from the level aggregates
+    template<OrderSide Side> int Available(Tick limit, int qty);
+    template<OrderSide Side> int Available(const Order *theOrder, int qty) { return Available<Side>(LimitTick<Side>(theOrder), qty); }
+
+    //trades theOrder (on Side) against the opposite side, updates its leaves qty and status, returns the qty it got
+    template<OrderSide Side> int Sweep(Order *theOrder);
+    //Sweep for an order that rests, what is left of it goes to its level afterwards, a filled order is retired
+    template<OrderSide Side> void Match(Order *theOrder);
+    template<OrderSide Side> void Deactivate(Order *order);
+    //takes an active order off the book on behalf of its owner (Canceled) or the clock (Expired)
+    void Cancel(Order *order, OrderStatus status);
+    void Report(EventType type, Order *order, int qty);
+    void ReportFill(Order *aggressor, Order *resting, int qty, int aggressorLeavesQty);
+    void Retire(Order *order);
+
+    template<OrderSide Side> void AddToPx(Order *order, Tick px);
+    template<OrderSide Side> void AmendOnPx(Order *order, Tick px);
+    template<OrderSide Side> void RemoveFromPx(Order *order, Tick px);
 
-    void Match(Order *theOrder);
-    void Deactivate(Order *order);
+    OrderPool pool;
+    OrderIndex orders;              //id -> orders (alive and retained finished orders)
+    BidLadder buyLevels;            //tick -> alive buy-side orders
+    AskLadder sellLevels;           //tick -> alive sell-side orders
+    DepthCache buyDepth;
+    DepthCache sellDepth;
+    TimerWheel expiries;            //GTD order ids by expiry time, the book's logical clock
 
-    void AddToPx(Order *order, double px);
-    void AmendOnPx(Order *order, double px);
-    void RemoveFromPx(Order *order, double px);
+    //finished orders in the order they finished, linked through Order::prev/next
+    Order *retiredHead = NULL;
+    Order *retiredTail = NULL;
+    size_t retiredCount = 0;
+    size_t retainedOrders;
 
-    std::map<int, Order *> orders;                                               //id -> orders map (all orders)
-    std::map<double, std::list<Order *>, std::greater<double >> buyPriceOrders;  //price -> alive buy-side orders map
-    std::map<double, std::list<Order *>> sellPriceOrders;                        //price -> alive sell-side orders map
+    EventBuffer *events = NULL;
+    MarketDataPublisher *marketData = NULL;
+    Journal *journal = NULL;
+    const char *snapshotFile = NULL;
+    BookViewPublisher *view = NULL;
+    bool viewChanged = false;       //top levels changed since the last publication
+    OutputBuffer replyBuffer;       //staging for the std::ostream overload
+#ifdef ORDERBOOK_STATS
+    BookStats stats;
+#endif
 
 };
 
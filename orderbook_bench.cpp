@@ -0,0 +1,255 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "orderbook.h"
+#include "orderflow.h"
+#include "textprotocol.h"
+
+using namespace std;
+
+//every benchmark times each operation on its own and reports the latency distribution per operation type
+//as counters (ns): NewOrder_p50, NewOrder_p99, NewOrder_p99.9, ...
+//the iteration time is the sum of the timed operations only, setup and refills are excluded
+
+typedef chrono::steady_clock Clock;
+
+class LatencyRecorder {
+
+public:
+    void Add(const char *op, Clock::duration elapsed) {
+        for(auto &samples: ops) {
+            if(samples.first == op) {
+                samples.second.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+                return;
+            }
+        }
+        ops.emplace_back(op, vector<uint32_t>());
+        ops.back().second.reserve(1 << 20);
+        Add(op, elapsed);
+    }
+
+    void Report(benchmark::State &state) {
+        for(auto &samples: ops) {
+            vector<uint32_t> &ns = samples.second;
+            if(ns.empty()) continue;
+            sort(ns.begin(), ns.end());
+            string op = samples.first;
+            state.counters[op + "_p50"] = Percentile(ns, 0.50);
+            state.counters[op + "_p99"] = Percentile(ns, 0.99);
+            state.counters[op + "_p99.9"] = Percentile(ns, 0.999);
+        }
+    }
+
+private:
+    static double Percentile(const vector<uint32_t> &sorted, double p) {
+        return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+    }
+
+    //few operation types, a linear scan on the name pointer beats a map
+    vector<pair<const char *, vector<uint32_t>>> ops;
+};
+
+static const char *OperationName(CommandType type) {
+    switch(type) {
+        case CommandType_NewOrder: return "NewOrder";
+        case CommandType_Amend: return "AmendOrder";
+        case CommandType_Cancel: return "CancelOrder";
+        case CommandType_QueryLevel: return "GetLevel";
+        case CommandType_QueryOrder: return "GetOrder";
+        case CommandType_QueryStats: return "GetStats";
+        case CommandType_Snapshot: return "SaveSnapshot";
+        case CommandType_MassCancel: return "MassCancel";
+        case CommandType_MassAmend: return "MassAmend";
+        case CommandType_Clock: return "AdvanceTime";
+    }
+    return "Unknown";
+}
+
+//times one command against the book
+static Clock::duration Timed(OrderBook &book, const Command &command, LatencyRecorder &latency) {
+    Reply reply;
+    auto start = Clock::now();
+    book.Execute(command, reply);
+    auto elapsed = Clock::now() - start;
+    benchmark::DoNotOptimize(reply);
+    latency.Add(OperationName(command.type), elapsed);
+    return elapsed;
+}
+
+static void Prefill(OrderBook &book, OrderFlowGenerator &flow, int orders) {
+    Command command;
+    Reply reply;
+    for(int i = 0; i < orders; ++i) {
+        flow.NextNew(command);
+        book.Execute(command, reply);
+    }
+}
+
+static void RunFlow(benchmark::State &state, const OrderFlowConfig &config, int prefill) {
+    OrderBook book;
+    OrderFlowGenerator flow(config);
+    Prefill(book, flow, prefill);
+    LatencyRecorder latency;
+    Command command;
+    for(auto _: state) {
+        flow.Next(command);
+        state.SetIterationTime(chrono::duration<double>(Timed(book, command, latency)).count());
+    }
+    latency.Report(state);
+}
+
+//resting orders spread over range(0) levels per side, balanced new/cancel so the book keeps its depth
+static void BM_DeepBook(benchmark::State &state) {
+    OrderFlowConfig config;
+    config.levels = (int)state.range(0);
+    config.newPct = 50;
+    config.amendPct = 10;
+    config.cancelPct = 40;
+    config.queryPct = 0;
+    config.aggressivePct = 2;
+    RunFlow(state, config, config.levels * 20);
+}
+BENCHMARK(BM_DeepBook)->Arg(10)->Arg(1000)->Arg(100000)->UseManualTime();
+
+//most orders are canceled again, typical for market makers
+static void BM_CancelHeavy(benchmark::State &state) {
+    OrderFlowConfig config;
+    config.newPct = 45;
+    config.amendPct = 5;
+    config.cancelPct = 48;
+    config.queryPct = 2;
+    config.aggressivePct = 1;
+    RunFlow(state, config, 10000);
+}
+BENCHMARK(BM_CancelHeavy)->UseManualTime();
+
+//level and order queries against a steady book
+static void BM_QueryHeavy(benchmark::State &state) {
+    OrderFlowConfig config;
+    config.newPct = 10;
+    config.amendPct = 0;
+    config.cancelPct = 10;
+    config.queryPct = 80;
+    config.aggressivePct = 0;
+    config.queryDepth = (int)state.range(0);
+    RunFlow(state, config, 10000);
+}
+BENCHMARK(BM_QueryHeavy)->Arg(1)->Arg(10)->Arg(50)->UseManualTime();
+
+//one aggressive order takes out range(0) levels of 10 orders each, the levels are refilled untimed
+static void BM_Sweep(benchmark::State &state) {
+    int levels = (int)state.range(0);
+    const int ordersPerLevel = 10;
+    OrderBook book;
+    LatencyRecorder latency;
+    Tick firstTick;
+    PxToTick(12.00, firstTick);
+    int nextId = 1;
+    Command command;
+    Reply reply;
+    for(auto _: state) {
+        command.type = CommandType_NewOrder;
+        command.side = OrderSide::OrderSide_Sell;
+        command.qty = 100;
+        for(int level = 0; level < levels; ++level) {
+            command.tick = firstTick + level;
+            for(int i = 0; i < ordersPerLevel; ++i) {
+                command.orderId = nextId++;
+                book.Execute(command, reply);
+            }
+        }
+        command.side = OrderSide::OrderSide_Buy;
+        command.orderId = nextId++;
+        command.qty = 100 * ordersPerLevel * levels;
+        command.tick = firstTick + levels - 1;
+        state.SetIterationTime(chrono::duration<double>(Timed(book, command, latency)).count());
+    }
+    latency.Report(state);
+    state.counters["levels"] = levels;
+}
+BENCHMARK(BM_Sweep)->Arg(1)->Arg(10)->Arg(100)->UseManualTime();
+
+//the whole text path: parse, execute, format
+static void BM_ProcessMessage(benchmark::State &state) {
+    OrderFlowConfig config;
+    OrderFlowGenerator flow(config);
+    OrderBook book;
+    Prefill(book, flow, 10000);
+
+    //messages are pre-formatted in batches, so formatting the input is not timed
+    const size_t messages = 1 << 16;
+    vector<string> lines(messages);
+    OutputBuffer text;
+    Command command;
+    auto generate = [&]() {
+        for(auto &line: lines) {
+            flow.Next(command);
+            text.Clear();
+            FormatCommand(command, text);
+            line.assign(text.Data(), text.Size() - 1);  //without the newline
+        }
+    };
+    generate();
+
+    LatencyRecorder latency;
+    OutputBuffer output;
+    size_t i = 0;
+    for(auto _: state) {
+        auto start = Clock::now();
+        book.ProcessMessage(lines[i], output);
+        auto elapsed = Clock::now() - start;
+        latency.Add("ProcessMessage", elapsed);
+        state.SetIterationTime(chrono::duration<double>(elapsed).count());
+        if(output.Size() > (1 << 16)) output.Clear();
+        if(++i == messages) {
+            generate();
+            i = 0;
+        }
+    }
+    latency.Report(state);
+}
+BENCHMARK(BM_ProcessMessage)->UseManualTime();
+
+//range(0) commands per call against a book too big for the caches, so prefetching has misses to hide
+//range(1) = 1 runs them through ExecuteBatch, 0 through a plain Execute loop over the same commands, as the baseline
+//no aggressive orders: a sweep through a book this deep costs far more than the lookups and would hide them
+//an iteration is one batch, items/s is the command rate
+static void BM_ExecuteBatch(benchmark::State &state) {
+    OrderFlowConfig config;
+    config.levels = 100000;
+    config.newPct = 45;
+    config.amendPct = 8;
+    config.cancelPct = 45;
+    config.queryPct = 2;
+    config.aggressivePct = 0;
+    OrderFlowGenerator flow(config);
+    OrderBook book;
+    Prefill(book, flow, 1000000);
+
+    size_t batch = (size_t)state.range(0);
+    bool batched = state.range(1) != 0;
+    vector<Command> commands(batch);
+    vector<Reply> replies(batch);
+    for(auto _: state) {
+        for(auto &command: commands) flow.Next(command);
+        auto start = Clock::now();
+        if(batched) {
+            book.ExecuteBatch(commands.data(), batch, replies.data());
+        } else {
+            for(size_t i = 0; i < batch; ++i) book.Execute(commands[i], replies[i]);
+        }
+        auto elapsed = Clock::now() - start;
+        benchmark::DoNotOptimize(replies.data());
+        state.SetIterationTime(chrono::duration<double>(elapsed).count());
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_ExecuteBatch)->Args({16, 0})->Args({16, 1})->Args({256, 0})->Args({256, 1})->UseManualTime();
+
+BENCHMARK_MAIN();
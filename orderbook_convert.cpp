@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "binaryprotocol.h"
+#include "bookview.h"
+#include "orderflow.h"
+#include "textprotocol.h"
+
+using namespace std;
+
+//converts order_book messages and replies between the text and the binary protocol, stdin -> stdout
+//  to-binary        text messages -> binary commands
+//  to-text          binary commands -> text messages
+//  replies-to-text  binary replies -> text replies
+//  events-to-text   binary execution reports -> text reports
+//  md-to-text       binary depth updates -> text depth updates
+//  generate N [SEED] N synthetic text messages with the default OrderFlowConfig mix, no input
+//  view PATH        the top of book order_book --view publishes at PATH, as a text depth snapshot
+
+static int TextToBinary(OutputBuffer &output) {
+    string line;
+    long lineNo = 0;
+    while(getline(cin, line)) {
+        ++lineNo;
+        Command command;
+        if(ParseMessage(line, command) != ParseError_None) {
+            //the binary protocol can't carry a malformed message, so it is dropped
+            cerr << "line " << lineNo << ": skipping invalid message: " << line << endl;
+            continue;
+        }
+        EncodeCommand(command, output.Claim(sizeof(BinaryCommand)));
+        output.Commit(sizeof(BinaryCommand));
+        if(output.Size() >= (1 << 16)) output.FlushTo(STDOUT_FILENO);
+    }
+    return 0;
+}
+
+template<typename Record, typename F>
+static int ForEachRecord(OutputBuffer &output, F f) {
+    vector<uint8_t> buf(sizeof(Record) * 4096);
+    size_t filled = 0;
+    long recordNo = 0;
+    for(;;) {
+        ssize_t n = read(STDIN_FILENO, buf.data() + filled, buf.size() - filled);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            cerr << "read error" << endl;
+            return 1;
+        }
+        if(n == 0) break;
+        filled += n;
+        size_t pos = 0;
+        for(; pos + sizeof(Record) <= filled; pos += sizeof(Record)) {
+            f(buf.data() + pos, ++recordNo);
+        }
+        memmove(buf.data(), buf.data() + pos, filled - pos);
+        filled -= pos;
+        output.FlushTo(STDOUT_FILENO);
+    }
+    if(filled) {
+        cerr << "ignoring " << filled << " trailing bytes" << endl;
+    }
+    return 0;
+}
+
+static int Generate(long messages, uint64_t seed, OutputBuffer &output) {
+    OrderFlowConfig config;
+    config.seed = seed;
+    OrderFlowGenerator flow(config);
+    Command command;
+    for(long i = 0; i < messages; ++i) {
+        flow.Next(command);
+        FormatCommand(command, output);
+        if(output.Size() >= (1 << 16)) output.FlushTo(STDOUT_FILENO);
+    }
+    return 0;
+}
+
+static int PrintView(const char *path, OutputBuffer &output) {
+    BookViewReader reader;
+    if(!reader.OpenShared(path)) {
+        cerr << "can't open book view " << path << endl;
+        return 1;
+    }
+    BookView view;
+    reader.Read(view);
+    FormatDepthUpdate(DepthUpdate{DepthUpdateType_Snapshot, OrderSide::OrderSide_Buy, InvalidTick, view.bidLevels, view.askLevels}, output);
+    for(int i = 0; i < view.bidLevels; ++i) {
+        const DepthEntry &entry = view.bids[i];
+        FormatDepthUpdate(DepthUpdate{DepthUpdateType_Level, OrderSide::OrderSide_Buy, entry.tick, entry.qty, entry.count}, output);
+    }
+    for(int i = 0; i < view.askLevels; ++i) {
+        const DepthEntry &entry = view.asks[i];
+        FormatDepthUpdate(DepthUpdate{DepthUpdateType_Level, OrderSide::OrderSide_Sell, entry.tick, entry.qty, entry.count}, output);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    string mode = argc > 1? argv[1]: "";
+    OutputBuffer output;
+    int ret;
+
+    if(mode == "to-binary") {
+        ret = TextToBinary(output);
+    } else if(mode == "generate" && argc > 2) {
+        ret = Generate(atol(argv[2]), argc > 3? strtoull(argv[3], NULL, 10): 1, output);
+    } else if(mode == "view" && argc > 2) {
+        ret = PrintView(argv[2], output);
+    } else if(mode == "to-text") {
+        ret = ForEachRecord<BinaryCommand>(output, [&output](const uint8_t *record, long recordNo) {
+            Command command;
+            if(!DecodeCommand(record, command)) {
+                cerr << "record " << recordNo << ": skipping invalid command" << endl;
+                return;
+            }
+            FormatCommand(command, output);
+        });
+    } else if(mode == "replies-to-text") {
+        ret = ForEachRecord<BinaryReply>(output, [&output](const uint8_t *record, long) {
+            Reply reply;
+            DecodeReply(record, reply);
+            FormatReply(reply, output);
+        });
+    } else if(mode == "events-to-text") {
+        ret = ForEachRecord<BinaryEvent>(output, [&output](const uint8_t *record, long) {
+            Event event;
+            DecodeEvent(record, event);
+            FormatEvent(event, output);
+        });
+    } else if(mode == "md-to-text") {
+        ret = ForEachRecord<BinaryDepthUpdate>(output, [&output](const uint8_t *record, long) {
+            DepthUpdate update;
+            DecodeDepthUpdate(record, update);
+            FormatDepthUpdate(update, output);
+        });
+    } else {
+        cerr << "usage: " << argv[0] << " to-binary|to-text|replies-to-text|events-to-text|md-to-text < input > output" << endl
+             << "       " << argv[0] << " generate N [SEED] > output" << endl
+             << "       " << argv[0] << " view PATH > output" << endl;
+        return 2;
+    }
+
+    output.FlushTo(STDOUT_FILENO);
+    return ret;
+}
@@ -1,17 +1,535 @@
-
-#include <string>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binaryprotocol.h"
+#include "bookmanager.h"
+#include "bookview.h"
+#include "journal.h"
 #include "orderbook.h"
+#include "pipeline.h"
+#include "shmtransport.h"
+#include "textprotocol.h"
 
 using namespace std;
 
-int main() {
-    OrderBook mgr;
-    string line;
+struct Options {
+    const char *inputFile = NULL;   //mmap'd when given, stdin otherwise
+    bool binary = false;            //fixed-width binary records instead of text lines
+    const char *eventsFile = NULL;  //execution reports go here, in the same protocol as replies
+    const char *mdFile = NULL;      //depth updates go here, in the same protocol as replies
+    bool mdConflate = false;        //one update per changed level per flush
+    size_t mdSnapshotEvery = 0;     //full snapshot every N flushes, 0 = never
+    bool symbols = false;           //messages are prefixed by a symbol, one book per symbol
+    int threads = 1;                //matching threads with symbols
+    bool pinCores = true;
+    size_t batchSize = 4096;        //max messages between two output flushes
+    long flushMicros = 0;           //max time a reply may sit in the output buffer, 0 = per batch only
+    bool dumpStats = false;         //stats of every book to stderr on exit
+    const char *journalFile = NULL; //write-ahead journal, replayed on startup
+    bool journalSync = false;       //wait for the disk on every journal commit
+    const char *snapshotFile = NULL;//loaded on startup, saved by the "snapshot" message and the timer
+    long snapshotSeconds = 0;       //save a snapshot at most this often, 0 = on request only
+    const char *viewFile = NULL;    //top of book published for readers in other processes
+    const char *shmName = NULL;     //commands, replies and events over shared-memory rings instead of stdin/stdout
+    bool busyPoll = false;          //spin on empty rings and queues instead of backing off
+    bool pipeline = false;          //parse, match and format on three threads
+};
 
-    while(getline(cin, line)) {
-        mgr.ProcessMessage(line, cout);
+static void Usage(const char *name) {
+    cerr << "usage: " << name << " [--binary] [--events PATH] [--md PATH [--md-conflate] [--md-snapshot N]] [--symbols [--threads N] [--no-pin]] [--batch N] [--flush-us N] [--stats] [--journal PATH [--journal-sync]] [--snapshot PATH [--snapshot-every N]] [--view PATH] [--shm NAME] [--pipeline] [--busy-poll] [FILE]" << endl
+         << "  reads messages from FILE (mmap'd) or stdin, replies go to stdout" << endl
+         << "  --binary      messages and replies use the binary protocol (see binaryprotocol.h)" << endl
+         << "  --events PATH write fill/amend/cancel reports to PATH" << endl
+         << "  --md PATH     write depth updates to PATH" << endl
+         << "  --md-conflate merge updates to the same level between two flushes" << endl
+         << "  --md-snapshot N write a full depth snapshot every N flushes" << endl
+         << "  --symbols     text messages start with a symbol (AAPL order 1001 buy 100 12.30), one book per symbol" << endl
+         << "  --threads N   match symbols on N worker threads (default 1)" << endl
+         << "  --no-pin      do not pin worker threads to cores" << endl
+         << "  --batch N     flush replies at least every N messages (default 4096)" << endl
+         << "  --flush-us N  flush replies at most N microseconds after they were produced" << endl
+         << "  --stats       print counters and latency histograms to stderr on exit (also: q stats)" << endl
+         << "  --journal PATH replay the journal at PATH, then append every book-changing command to it" << endl
+         << "  --journal-sync commit the journal to disk before replies are written, not just to the page cache" << endl
+         << "  --snapshot PATH start from the snapshot at PATH (plus the journal behind it), save to it on a snapshot message" << endl
+         << "  --snapshot-every N also save a snapshot every N seconds" << endl
+         << "  --view PATH   publish the top levels to PATH (e.g. /dev/shm/book) for lock-free readers, see bookview.h" << endl
+         << "  --shm NAME    take binary commands from the shared-memory segment NAME (e.g. /orderbook) and put replies" << endl
+         << "                and events (if the gateway subscribed) back into it, see shmtransport.h; runs until the gateway closes it" << endl
+         << "  --pipeline    parse, match and format/write on three threads (cores 0-2), see pipeline.h" << endl
+         << "  --busy-poll   with --shm, --pipeline or --symbols, spin on empty rings and queues instead of backing off (burns cores)" << endl;
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg == "--binary") {
+            options.binary = true;
+        } else if(arg == "--events" && i + 1 < argc) {
+            options.eventsFile = argv[++i];
+        } else if(arg == "--md" && i + 1 < argc) {
+            options.mdFile = argv[++i];
+        } else if(arg == "--md-conflate") {
+            options.mdConflate = true;
+        } else if(arg == "--md-snapshot" && i + 1 < argc) {
+            options.mdSnapshotEvery = strtoul(argv[++i], NULL, 10);
+        } else if(arg == "--symbols") {
+            options.symbols = true;
+        } else if(arg == "--threads" && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+            if(options.threads < 1) return false;
+        } else if(arg == "--no-pin") {
+            options.pinCores = false;
+        } else if(arg == "--batch" && i + 1 < argc) {
+            options.batchSize = strtoul(argv[++i], NULL, 10);
+            if(!options.batchSize) return false;
+        } else if(arg == "--flush-us" && i + 1 < argc) {
+            options.flushMicros = strtol(argv[++i], NULL, 10);
+        } else if(arg == "--stats") {
+            options.dumpStats = true;
+        } else if(arg == "--journal" && i + 1 < argc) {
+            options.journalFile = argv[++i];
+        } else if(arg == "--journal-sync") {
+            options.journalSync = true;
+        } else if(arg == "--snapshot" && i + 1 < argc) {
+            options.snapshotFile = argv[++i];
+        } else if(arg == "--snapshot-every" && i + 1 < argc) {
+            options.snapshotSeconds = strtol(argv[++i], NULL, 10);
+        } else if(arg == "--view" && i + 1 < argc) {
+            options.viewFile = argv[++i];
+        } else if(arg == "--shm" && i + 1 < argc) {
+            options.shmName = argv[++i];
+            options.binary = true;
+        } else if(arg == "--pipeline") {
+            options.pipeline = true;
+        } else if(arg == "--busy-poll") {
+            options.busyPoll = true;
+        } else if(arg.size() > 1 && arg[0] == '-') {
+            return false;
+        } else {
+            options.inputFile = argv[i];
+        }
     }
+    //multi-symbol mode has no binary encoding, no per-book event or depth stream and no per-book journal, snapshot or view yet
+    if(options.symbols && (options.binary || options.eventsFile || options.mdFile || options.journalFile || options.snapshotFile || options.viewFile)) return false;
+    //the segment carries the event stream and replaces the input
+    if(options.shmName && (options.eventsFile || options.inputFile)) return false;
+    //the pipeline's stages own the book, the depth stream, the journal commit and the snapshot timer would have to run on the matching thread
+    return !options.pipeline || (!options.symbols && !options.shmName && !options.mdFile && !options.journalFile && !options.snapshotSeconds);
 }
 
+//splits input into messages in place and feeds them to the book, replies are collected and written out per batch
+class Driver {
+
+public:
+    Driver(OrderBook &book, BookManager *manager, Journal *journal, const Options &options, int eventsFd, int mdFd):
+        book(book), manager(manager), journal(journal), options(options), eventsFd(eventsFd), mdFd(mdFd), marketData(options.mdConflate) {
+        if(eventsFd >= 0) book.SetEventBuffer(&events);
+        if(mdFd >= 0) book.SetMarketDataPublisher(&marketData);
+    }
+
+    //replies and events go to the rings of shm instead of stdout and the events file
+    //events are only produced once the gateway subscribed to them, see PollSubscription
+    void SetTransport(ShmTransport *shm) {
+        this->shm = shm;
+        book.SetEventBuffer(NULL);
+    }
+
+    void PollSubscription() {
+        if(eventsAttached || !shm->EventsSubscribed()) return;
+        book.SetEventBuffer(&events);
+        eventsAttached = true;
+    }
+
+    //messages go to pipeline's parser stage, which writes replies and events itself
+    void SetPipeline(Pipeline *pipeline) { this->pipeline = pipeline; }
+
+    //processes every complete message of data, returns number of bytes consumed
+    //at eof a trailing text line without a newline is processed as well
+    size_t ProcessChunk(const char *data, size_t size, bool eof) {
+        size_t pos = options.binary? ProcessRecords(data, size): ProcessLines(data, size, eof);
+        Flush();
+        return pos;
+    }
+
+    bool Flush() {
+        pending = 0;
+        if(pipeline) return true;
+        if(manager) manager->Flush(output);
+        //group commit: nothing this batch caused leaves the process before its commands are journaled
+        if(journal && !journal->Commit() && !journalFailed) {
+            journalFailed = true;
+            cerr << "journal commit failed: " << strerror(errno) << endl;
+        }
+        if(!events.Empty()) {
+            for(size_t i = 0; i < events.Size(); ++i) {
+                if(options.binary) {
+                    EncodeEvent(events.Data()[i], eventOutput.Claim(sizeof(BinaryEvent)));
+                    eventOutput.Commit(sizeof(BinaryEvent));
+                } else {
+                    FormatEvent(events.Data()[i], eventOutput);
+                }
+            }
+            events.Clear();
+            if(shm) PushTo(shm->Events(), eventOutput); else eventOutput.FlushTo(eventsFd);
+        }
+        if(mdFd >= 0) FlushMarketData();
+        if(options.snapshotSeconds) SnapshotIfDue();
+        if(shm) {
+            PushTo(shm->Replies(), output);
+            return true;
+        }
+        return output.Empty() || output.FlushTo(STDOUT_FILENO);
+    }
+
+private:
+    //waits for the gateway while the ring is full, its Send drains replies and events while it waits for room
+    void PushTo(ShmRing &ring, OutputBuffer &buffer) {
+        ring.PushAll((const uint8_t *)buffer.Data(), buffer.Size() / ShmRing::RecordSize, wait);
+        buffer.Clear();
+    }
+
+    void SnapshotIfDue() {
+        auto now = chrono::steady_clock::now();
+        if(chrono::duration_cast<chrono::seconds>(now - lastSnapshot).count() < options.snapshotSeconds) return;
+        lastSnapshot = now;
+        if(!book.SaveSnapshot(options.snapshotFile))
+            cerr << "can't save snapshot " << options.snapshotFile << ": " << strerror(errno) << endl;
+    }
+
+    void FlushMarketData() {
+        if(options.mdSnapshotEvery && ++flushes % options.mdSnapshotEvery == 0) marketData.Snapshot(book);
+        if(marketData.Empty()) return;
+        for(size_t i = 0; i < marketData.Size(); ++i) {
+            if(options.binary) {
+                EncodeDepthUpdate(marketData.Data()[i], mdOutput.Claim(sizeof(BinaryDepthUpdate)));
+                mdOutput.Commit(sizeof(BinaryDepthUpdate));
+            } else {
+                FormatDepthUpdate(marketData.Data()[i], mdOutput);
+            }
+        }
+        marketData.Clear();
+        mdOutput.FlushTo(mdFd);
+    }
+
+    size_t ProcessLines(const char *data, size_t size, bool eof) {
+        size_t pos = 0;
+        while(pos < size) {
+            const char *nl = (const char *)memchr(data + pos, '\n', size - pos);
+            if(!nl) {
+                if(!eof) break;
+                ProcessLine(string_view(data + pos, size - pos));
+                pos = size;
+                break;
+            }
+            ProcessLine(string_view(data + pos, nl - (data + pos)));
+            pos = nl - data + 1;
+        }
+        return pos;
+    }
+
+    size_t ProcessRecords(const char *data, size_t size) {
+        size_t count = size / sizeof(BinaryCommand);
+        const uint8_t *records = (const uint8_t *)data;
+        if(pipeline || manager) {
+            for(size_t i = 0; i < count; ++i) ProcessRecord(records + i * sizeof(BinaryCommand));
+            return count * sizeof(BinaryCommand);
+        }
+        //decoded into bursts the book executes with ExecuteBatch, an invalid record ends a burst early
+        size_t decoded = 0;
+        for(size_t i = 0; i < count; ++i) {
+            if(DecodeCommand(records + i * sizeof(BinaryCommand), batch[decoded])) {
+                if(++decoded == BatchSize) {
+                    ExecuteBatch(decoded);
+                    decoded = 0;
+                }
+                continue;
+            }
+            ExecuteBatch(decoded);
+            bool wasEmpty = output.Empty();
+            Reply reply;
+            reply.type = ReplyType_Invalid;
+            reply.id = batch[decoded].orderId;
+            EncodeReply(reply, output.Claim(sizeof(BinaryReply)));
+            output.Commit(sizeof(BinaryReply));
+            decoded = 0;
+            OnProcessed(wasEmpty);
+        }
+        ExecuteBatch(decoded);
+        return count * sizeof(BinaryCommand);
+    }
+
+    void ExecuteBatch(size_t count) {
+        if(!count) return;
+        bool wasEmpty = output.Empty();
+        if(book.ExecuteBatch(batch, count, batchReplies)) {
+            for(size_t i = 0; i < count; ++i) {
+                if(batchReplies[i].type == ReplyType_None) continue;
+                EncodeReply(batchReplies[i], output.Claim(sizeof(BinaryReply)));
+                output.Commit(sizeof(BinaryReply));
+            }
+        }
+        OnProcessed(wasEmpty, count);
+    }
+
+    void ProcessLine(string_view line) {
+        if(pipeline) {
+            pipeline->ProcessMessage(line);
+            return;
+        }
+        bool wasEmpty = output.Empty();
+        if(manager) {
+            manager->ProcessMessage(line, output);
+        } else {
+            book.ProcessMessage(line, output);
+        }
+        OnProcessed(wasEmpty);
+    }
+
+    void ProcessRecord(const uint8_t *record) {
+        if(pipeline) {
+            pipeline->ProcessRecord(record);
+            return;
+        }
+        bool wasEmpty = output.Empty();
+        Command command;
+        Reply reply;
+        if(!DecodeCommand(record, command)) {
+            reply.type = ReplyType_Invalid;
+            reply.id = command.orderId;
+            EncodeReply(reply, output.Claim(sizeof(BinaryReply)));
+            output.Commit(sizeof(BinaryReply));
+        } else if(book.Execute(command, reply)) {
+            EncodeReply(reply, output.Claim(sizeof(BinaryReply)));
+            output.Commit(sizeof(BinaryReply));
+        }
+        OnProcessed(wasEmpty);
+    }
+
+    void OnProcessed(bool wasEmpty, size_t messages = 1) {
+        if((pending += messages) >= options.batchSize) {
+            Flush();
+        } else if(options.flushMicros) {
+            auto now = chrono::steady_clock::now();
+            if(wasEmpty) {
+                oldestReply = now;
+            } else if(chrono::duration_cast<chrono::microseconds>(now - oldestReply).count() >= options.flushMicros) {
+                Flush();
+            }
+        }
+    }
+
+    static const size_t BatchSize = 256;
+
+    OrderBook &book;
+    BookManager *manager;
+    Journal *journal;
+    bool journalFailed = false;
+    const Options &options;
+    ShmTransport *shm = NULL;
+    Pipeline *pipeline = NULL;
+    WaitStrategy wait{options.busyPoll};
+    OutputBuffer output;
+    Command batch[BatchSize];
+    Reply batchReplies[BatchSize];
+    int eventsFd;
+    EventBuffer events;
+    bool eventsAttached = false;     //shm only: the gateway subscribed to events
+    OutputBuffer eventOutput;
+    int mdFd;
+    MarketDataPublisher marketData;
+    OutputBuffer mdOutput;
+    size_t flushes = 0;
+    size_t pending = 0;
+    chrono::steady_clock::time_point oldestReply;
+    chrono::steady_clock::time_point lastSnapshot = chrono::steady_clock::now();
+};
+
+static int RunFile(Driver &driver, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        cerr << "can't open " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        cerr << "can't stat " << path << ": " << strerror(errno) << endl;
+        close(fd);
+        return 1;
+    }
+    if(st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            cerr << "can't mmap " << path << ": " << strerror(errno) << endl;
+            close(fd);
+            return 1;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        driver.ProcessChunk((const char *)data, st.st_size, true);
+        munmap(data, st.st_size);
+    }
+    close(fd);
+    return 0;
+}
+
+static int RunStdin(Driver &driver) {
+    vector<char> buf(1 << 20);
+    size_t filled = 0;
+    for(;;) {
+        if(filled == buf.size()) buf.resize(buf.size() * 2);    //line longer than the buffer
+        ssize_t n = read(STDIN_FILENO, buf.data() + filled, buf.size() - filled);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            cerr << "read error: " << strerror(errno) << endl;
+            return 1;
+        }
+        bool eof = n == 0;
+        filled += n;
+        size_t used = driver.ProcessChunk(buf.data(), filled, eof);
+        if(eof) return 0;
+        memmove(buf.data(), buf.data() + used, filled - used);
+        filled -= used;
+    }
+}
+
+//commands are matched straight out of the ring and released once their replies are pushed
+static int RunShm(Driver &driver, ShmTransport &shm, bool busyPoll) {
+    WaitStrategy wait(busyPoll);
+    ShmRing &commands = shm.Commands();
+    for(;;) {
+        //the gateway commits its last command before it shuts down, so an empty ring after the flag is really the end
+        bool done = shm.IsShutdown();
+        size_t count;
+        const uint8_t *records = commands.Peek(count);
+        if(count) {
+            wait.Reset();
+            driver.PollSubscription();
+            driver.ProcessChunk((const char *)records, count * ShmRing::RecordSize, false);
+            commands.Consume(count);
+        } else if(done) {
+            return 0;
+        } else {
+            wait.Idle();
+        }
+    }
+}
+
+//the parameters are unused when stats are compiled out
+static void DumpStats([[maybe_unused]] OrderBook &book, [[maybe_unused]] BookManager *manager) {
+#ifdef ORDERBOOK_STATS
+    OutputBuffer output;
+    if(manager) {
+        manager->ForEachBook([&output](string_view symbol, OrderBook &book) {
+            output.Append(symbol);
+            output.Append('\n');
+            FormatStats(book.GetStats(), output);
+        });
+    } else {
+        FormatStats(book.GetStats(), output);
+    }
+    output.FlushTo(STDERR_FILENO);
+#else
+    cerr << "stats are not compiled in, rebuild with -DORDERBOOK_STATS=ON" << endl;
+#endif
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    int eventsFd = -1;
+    if(options.eventsFile) {
+        eventsFd = open(options.eventsFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(eventsFd < 0) {
+            cerr << "can't open " << options.eventsFile << ": " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+
+    int mdFd = -1;
+    if(options.mdFile) {
+        mdFd = open(options.mdFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(mdFd < 0) {
+            cerr << "can't open " << options.mdFile << ": " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+
+    OrderBook mgr;
+    uint64_t snapshotRecords = 0;
+    if(options.snapshotFile) {
+        if(access(options.snapshotFile, F_OK) == 0 && !mgr.LoadSnapshot(options.snapshotFile, snapshotRecords)) {
+            cerr << "can't load snapshot " << options.snapshotFile << endl;
+            return 1;
+        }
+        mgr.SetSnapshotFile(options.snapshotFile);
+    }
+    Journal journal;
+    if(options.journalFile) {
+        if(!journal.Open(options.journalFile, options.journalSync)) {
+            cerr << "can't open journal " << options.journalFile << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        if(journal.Records() < snapshotRecords) {
+            cerr << "journal " << options.journalFile << " is behind snapshot " << options.snapshotFile << endl;
+            return 1;
+        }
+        //before anything is attached, recovery produces no replies, events or depth updates
+        auto start = chrono::steady_clock::now();
+        size_t recovered = journal.Replay(mgr, snapshotRecords);
+        auto micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        if(recovered) cerr << "recovered " << recovered << " commands from " << options.journalFile << " in " << micros << "us" << endl;
+        mgr.SetJournal(&journal);
+    }
+    BookViewPublisher view;
+    if(options.viewFile) {
+        if(!view.OpenShared(options.viewFile)) {
+            cerr << "can't open book view " << options.viewFile << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        mgr.SetBookView(&view);
+    }
+    unique_ptr<BookManager> manager;
+    if(options.symbols) manager.reset(new BookManager(options.threads, options.pinCores, options.busyPoll));
+    Driver driver(mgr, manager.get(), options.journalFile? &journal: NULL, options, eventsFd, mdFd);
+    int ret;
+    if(options.shmName) {
+        ShmTransport shm;
+        if(!shm.Create(options.shmName)) {
+            cerr << "can't create shared memory " << options.shmName << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        driver.SetTransport(&shm);
+        ret = RunShm(driver, shm, options.busyPoll);
+        ShmTransport::Unlink(options.shmName);
+    } else if(options.pipeline) {
+        Pipeline pipeline(mgr, options.binary, STDOUT_FILENO, eventsFd, options.pinCores, options.busyPoll);
+        driver.SetPipeline(&pipeline);
+        ret = options.inputFile? RunFile(driver, options.inputFile): RunStdin(driver);
+        if(!pipeline.Finish() && !ret) {
+            cerr << "write error: " << strerror(errno) << endl;
+            ret = 1;
+        }
+    } else {
+        ret = options.inputFile? RunFile(driver, options.inputFile): RunStdin(driver);
+    }
+    if(options.dumpStats) DumpStats(mgr, manager.get());
+    if(eventsFd >= 0) close(eventsFd);
+    if(mdFd >= 0) close(mdFd);
+    return ret;
+}
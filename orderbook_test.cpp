@@ -2,7 +2,21 @@
 #include <boost/test/included/unit_test.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string.hpp>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 #include "orderbook.h"
+#include "binaryprotocol.h"
+#include "bookmanager.h"
+#include "bookview.h"
+#include "journal.h"
+#include "orderflow.h"
+#include "pipeline.h"
+#include "shmtransport.h"
+#include "textprotocol.h"
+#include "timerwheel.h"
 
 using namespace std;
 using namespace boost::unit_test;
@@ -12,9 +26,9 @@ BOOST_AUTO_TEST_CASE( test_new ) {
     int orderId = 100000;
     mgr.NewOrder(orderId, OrderSide::OrderSide_Sell, 1, 1075);
     Order * order1 = mgr.GetOrder(orderId);
-    BOOST_CHECK_EQUAL(order1->orderQty, 1);
+    BOOST_CHECK_EQUAL(order1->OrderQty(), 1);
     BOOST_CHECK_EQUAL(order1->status, OrderStatus_New);
-    BOOST_CHECK_EQUAL(order1->orderPx, 1075);
+    BOOST_CHECK_EQUAL(order1->OrderPx(), 1075);
 }
 
 BOOST_AUTO_TEST_CASE( test_new_duplicated ) {
@@ -23,7 +37,7 @@ BOOST_AUTO_TEST_CASE( test_new_duplicated ) {
     mgr.NewOrder(orderId, OrderSide::OrderSide_Sell, 1, 1075);
     mgr.NewOrder(orderId, OrderSide::OrderSide_Sell, 2, 1075);
     Order * order = mgr.GetOrder(orderId);
-    BOOST_CHECK_EQUAL(order->orderQty, 1);
+    BOOST_CHECK_EQUAL(order->OrderQty(), 1);
 }
 
 BOOST_AUTO_TEST_CASE( test_amend ) {
@@ -32,7 +46,7 @@ BOOST_AUTO_TEST_CASE( test_amend ) {
     mgr.NewOrder(orderId, OrderSide::OrderSide_Sell, 1, 1075);
     mgr.AmendOrder(orderId, 2);
     Order * order = mgr.GetOrder(orderId);
-    BOOST_CHECK_EQUAL(order->orderQty, 2);
+    BOOST_CHECK_EQUAL(order->OrderQty(), 2);
 }
 
 BOOST_AUTO_TEST_CASE( test_amend_missing ) {
@@ -65,12 +79,12 @@ BOOST_AUTO_TEST_CASE( test_executions ) {
 
     order10 = mgr.GetOrder(10);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_PartiallyFilled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 1 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 1 );
 
     mgr.NewOrder(30, OrderSide::OrderSide_Buy, 5, 2000);
     order10 = mgr.GetOrder(10);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_Filled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 3 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 3 );
 }
 
 BOOST_AUTO_TEST_CASE( test_executions_2 ) {
@@ -90,7 +104,7 @@ BOOST_AUTO_TEST_CASE( test_executions_cancel ) {
     mgr.NewOrder(30, OrderSide::OrderSide_Buy, 5, 2000);
     Order *order10 = mgr.GetOrder(10);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_Canceled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 0 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 0 );
 }
 
 
@@ -102,9 +116,9 @@ BOOST_AUTO_TEST_CASE( test_executions_multi_price_priority ) {
     Order *order10 = mgr.GetOrder(10);
     Order *order11 = mgr.GetOrder(11);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_PartiallyFilled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 1 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 1 );
     BOOST_CHECK_EQUAL(order11->status, OrderStatus_New );
-    BOOST_CHECK_EQUAL(order11->cumQty, 0 );
+    BOOST_CHECK_EQUAL(order11->CumQty(), 0 );
 
 
 }
@@ -117,9 +131,9 @@ BOOST_AUTO_TEST_CASE( test_executions_time_priority ) {
     Order *order10 = mgr.GetOrder(10);
     Order *order11 = mgr.GetOrder(11);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_PartiallyFilled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 1 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 1 );
     BOOST_CHECK_EQUAL(order11->status, OrderStatus_New );
-    BOOST_CHECK_EQUAL(order11->cumQty, 0 );
+    BOOST_CHECK_EQUAL(order11->CumQty(), 0 );
 
 }
 
@@ -132,9 +146,9 @@ BOOST_AUTO_TEST_CASE( test_executions_time_priority_amend_down ) {
     Order *order10 = mgr.GetOrder(10);
     Order *order11 = mgr.GetOrder(11);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_PartiallyFilled );
-    BOOST_CHECK_EQUAL(order10->cumQty, 1 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 1 );
     BOOST_CHECK_EQUAL(order11->status, OrderStatus_New );
-    BOOST_CHECK_EQUAL(order11->cumQty, 0 );
+    BOOST_CHECK_EQUAL(order11->CumQty(), 0 );
 }
 
 BOOST_AUTO_TEST_CASE( test_executions_time_priority_amend_up ) {
@@ -146,9 +160,9 @@ BOOST_AUTO_TEST_CASE( test_executions_time_priority_amend_up ) {
     Order *order10 = mgr.GetOrder(10);
     Order *order11 = mgr.GetOrder(11);
     BOOST_CHECK_EQUAL(order10->status, OrderStatus_New );
-    BOOST_CHECK_EQUAL(order10->cumQty, 0 );
+    BOOST_CHECK_EQUAL(order10->CumQty(), 0 );
     BOOST_CHECK_EQUAL(order11->status, OrderStatus_PartiallyFilled );
-    BOOST_CHECK_EQUAL(order11->cumQty, 1 );
+    BOOST_CHECK_EQUAL(order11->CumQty(), 1 );
 }
 
 BOOST_AUTO_TEST_CASE( test_level_buy ) {
@@ -215,5 +229,1465 @@ BOOST_AUTO_TEST_CASE( test_processmessage ) {
     BOOST_CHECK_EQUAL(boost::trim_copy(s2.str()), "bid, 0, 12.15, 600, 1");
     BOOST_CHECK_EQUAL(boost::trim_copy(s3.str()), "order, 1004, New, 600, 0");
     BOOST_CHECK_EQUAL(boost::trim_copy(s4.str()), "order, 1001, Filled, 0, -1");
+
+    //a negative depth is no level, not the best one
+    stringstream s5;
+    mgr.ProcessMessage("q level bid -1", s5);
+    BOOST_CHECK_EQUAL(boost::trim_copy(s5.str()), "bid, -1, 0, 0, 0");
+}
+
+
+BOOST_AUTO_TEST_CASE( test_tick_table ) {
+    Tick tick;
+    BOOST_CHECK(PxToTick(0.001, tick));
+    BOOST_CHECK_EQUAL(tick, 1);
+    BOOST_CHECK(PxToTick(0.2, tick));
+    BOOST_CHECK_EQUAL(tick, TickBand1First);
+    BOOST_CHECK(PxToTick(0.205, tick));
+    BOOST_CHECK_EQUAL(tick, TickBand1First + 1);
+    BOOST_CHECK(PxToTick(2.0, tick));
+    BOOST_CHECK_EQUAL(tick, TickBand2First);
+    BOOST_CHECK(PxToTick(12.15, tick));
+    BOOST_CHECK_EQUAL(TickToPx(tick), 12.15);
+    BOOST_CHECK(PxToTick(1.995, tick));
+    BOOST_CHECK_EQUAL(tick + 1, TickBand2First);
+
+    BOOST_CHECK(!PxToTick(0.2001, tick));
+    BOOST_CHECK(!PxToTick(0.207, tick));
+    BOOST_CHECK(!PxToTick(12.155, tick));
+    BOOST_CHECK(!PxToTick(0, tick));
+    BOOST_CHECK(!PxToTick(-1, tick));
+}
+
+BOOST_AUTO_TEST_CASE( test_new_off_tick ) {
+    OrderBook mgr;
+    mgr.NewOrder(1001, OrderSide::OrderSide_Buy, 100, 12.155);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1001), nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( test_level_wide_range ) {
+    OrderBook mgr;
+    mgr.NewOrder(1, OrderSide::OrderSide_Sell, 10, 12.30);
+    mgr.NewOrder(2, OrderSide::OrderSide_Sell, 20, 0.5);
+    mgr.NewOrder(3, OrderSide::OrderSide_Sell, 30, 5000);
+    mgr.NewOrder(4, OrderSide::OrderSide_Sell, 40, 12.31);
+
+    auto ret0 = mgr.GetLevel(OrderSide::OrderSide_Sell, 0);
+    auto ret1 = mgr.GetLevel(OrderSide::OrderSide_Sell, 1);
+    auto ret3 = mgr.GetLevel(OrderSide::OrderSide_Sell, 3);
+    BOOST_CHECK_EQUAL(get<0>(ret0), 0.5 );
+    BOOST_CHECK_EQUAL(get<0>(ret1), 12.30 );
+    BOOST_CHECK_EQUAL(get<0>(ret3), 5000 );
+    BOOST_CHECK_EQUAL(get<1>(ret3), 30 );
+
+    mgr.NewOrder(5, OrderSide::OrderSide_Buy, 25, 12.30);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(2)->status, OrderStatus_Filled );
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1)->CumQty(), 5 );
+    auto ret = mgr.GetLevel(OrderSide::OrderSide_Sell, 0);
+    BOOST_CHECK_EQUAL(get<0>(ret), 12.30 );
+    BOOST_CHECK_EQUAL(get<1>(ret), 5 );
+}
+
+BOOST_AUTO_TEST_CASE( test_level_aggregates ) {
+    OrderBook mgr;
+    mgr.NewOrder(10, OrderSide::OrderSide_Sell, 5, 1080);
+    mgr.NewOrder(11, OrderSide::OrderSide_Sell, 3, 1080);
+    mgr.NewOrder(12, OrderSide::OrderSide_Buy, 2, 1080);
+    auto ret = mgr.GetLevel(OrderSide::OrderSide_Sell, 0);
+    BOOST_CHECK_EQUAL(get<1>(ret), 6 );
+    BOOST_CHECK_EQUAL(get<2>(ret), 2 );
+
+    mgr.NewOrder(13, OrderSide::OrderSide_Buy, 10, 1070);
+    mgr.NewOrder(14, OrderSide::OrderSide_Sell, 4, 1070);
+    ret = mgr.GetLevel(OrderSide::OrderSide_Buy, 0);
+    BOOST_CHECK_EQUAL(get<1>(ret), 6 );
+    BOOST_CHECK_EQUAL(get<2>(ret), 1 );
+
+    mgr.AmendOrder(11, 1);
+    mgr.AmendOrder(13, 20);
+    ret = mgr.GetLevel(OrderSide::OrderSide_Sell, 0);
+    BOOST_CHECK_EQUAL(get<1>(ret), 4 );
+    ret = mgr.GetLevel(OrderSide::OrderSide_Buy, 0);
+    BOOST_CHECK_EQUAL(get<1>(ret), 16 );
+
+    mgr.AmendOrder(10, 1);
+    ret = mgr.GetLevel(OrderSide::OrderSide_Sell, 0);
+    BOOST_CHECK_EQUAL(get<1>(ret), 1 );
+    BOOST_CHECK_EQUAL(get<2>(ret), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( test_queue_position ) {
+    OrderBook mgr;
+    stringstream s;
+    for(int id = 1; id <= 5; ++id) {
+        mgr.NewOrder(id, OrderSide::OrderSide_Buy, 10, 12.30);
+    }
+    mgr.ProcessMessage("q order 4", s);
+    BOOST_CHECK_EQUAL(boost::trim_copy(s.str()), "order, 4, New, 10, 3");
+
+    mgr.CancelOrder(1);
+    mgr.CancelOrder(3);
+    mgr.AmendOrder(2, 20);
+    s.str("");
+    mgr.ProcessMessage("q order 4", s);
+    mgr.ProcessMessage("q order 5", s);
+    mgr.ProcessMessage("q order 2", s);
+    BOOST_CHECK_EQUAL(boost::trim_copy(s.str()), "order, 4, New, 10, 0\norder, 5, New, 10, 1\norder, 2, New, 20, 2");
+}
+
+BOOST_AUTO_TEST_CASE( test_queue_position_after_cancels ) {
+    //one level against a model queue: mid-queue cancels, amends to the back, and stretches without queries
+    //the level drifts between short (walked) and long (seq tree), so folding and renumbering are exercised too
+    OrderBook mgr;
+    vector<int> queue;
+    int id = 1, wrong = 0;
+    size_t longest = 0;
+    stringstream s;
+    srand(3);
+    for(; id <= 20; ++id) {
+        mgr.NewOrder(id, OrderSide::OrderSide_Buy, 10, 12.30);
+        queue.push_back(id);
+    }
+    for(int step = 0; step < 20000; ++step) {
+        int action = rand() % 100;
+        int queryPct = (step / 1000) % 2? 0: 10;
+        if(queue.empty() || action < 40) {
+            mgr.NewOrder(id, OrderSide::OrderSide_Buy, 10, 12.30);
+            queue.push_back(id++);
+        } else if(action < 80) {
+            size_t at = rand() % queue.size();
+            mgr.CancelOrder(queue[at]);
+            queue.erase(queue.begin() + at);
+        } else if(action < 100 - queryPct) {
+            size_t at = rand() % queue.size();
+            int amended = queue[at];
+            mgr.AmendOrder(amended, 20);
+            mgr.AmendOrder(amended, 10);
+            queue.erase(queue.begin() + at);
+            queue.push_back(amended);
+        } else {
+            size_t at = rand() % queue.size();
+            s.str("");
+            mgr.ProcessMessage("q order " + to_string(queue[at]), s);
+            if(boost::trim_copy(s.str()) != "order, " + to_string(queue[at]) + ", New, 10, " + to_string(at)) ++wrong;
+        }
+        longest = max(longest, queue.size());
+    }
+    BOOST_CHECK_EQUAL(wrong, 0);
+    BOOST_CHECK(longest > 4 * QueueGaps::ShortLevel);
+#ifdef ORDERBOOK_STATS
+    BOOST_CHECK(mgr.GetStats().positionRenumber.Count() > 0);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( test_retention ) {
+    OrderBook mgr(2);
+    mgr.NewOrder(1, OrderSide::OrderSide_Sell, 10, 12.30);
+    mgr.NewOrder(2, OrderSide::OrderSide_Sell, 10, 12.30);
+    mgr.NewOrder(3, OrderSide::OrderSide_Sell, 10, 12.30);
+    mgr.CancelOrder(1);
+    mgr.CancelOrder(2);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1)->status, OrderStatus_Canceled );
+
+    mgr.NewOrder(4, OrderSide::OrderSide_Buy, 10, 12.30);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1), nullptr );
+    BOOST_CHECK_EQUAL(mgr.GetOrder(2), nullptr );
+    BOOST_CHECK_EQUAL(mgr.GetOrder(3)->status, OrderStatus_Filled );
+    BOOST_CHECK_EQUAL(mgr.GetOrder(4)->status, OrderStatus_Filled );
+
+    //recycled id can be used again
+    mgr.NewOrder(1, OrderSide::OrderSide_Buy, 5, 12.00);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1)->status, OrderStatus_New );
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1)->OrderQty(), 5 );
+}
+
+BOOST_AUTO_TEST_CASE( test_order_index ) {
+    OrderIndex index;
+    std::vector<Order> orders(5000);
+    for(int i = 0; i < (int)orders.size(); ++i) {
+        orders[i].orderId = i * 7;
+        index.Insert(i * 7, &orders[i]);
+    }
+    for(int i = 0; i < (int)orders.size(); i += 2) {
+        index.Erase(i * 7);
+    }
+    BOOST_CHECK_EQUAL(index.Size(), 2500 );
+    for(int i = 0; i < (int)orders.size(); ++i) {
+        BOOST_CHECK_EQUAL(index.Find(i * 7), i % 2? &orders[i]: nullptr);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_message ) {
+    Command command;
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 buy 100 12.30", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.type, CommandType_NewOrder);
+    BOOST_CHECK_EQUAL(command.orderId, 1001);
+    BOOST_CHECK_EQUAL(command.side, OrderSide_Buy);
+    BOOST_CHECK_EQUAL(command.qty, 100);
+    BOOST_CHECK_EQUAL(TickToPx(command.tick), 12.30);
+
+    BOOST_CHECK_EQUAL(ParseMessage("amend 1004 600\r", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.type, CommandType_Amend);
+    BOOST_CHECK_EQUAL(command.qty, 600);
+    BOOST_CHECK_EQUAL(ParseMessage("q level ask 2", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.type, CommandType_QueryLevel);
+    BOOST_CHECK_EQUAL(command.side, OrderSide_Sell);
+    BOOST_CHECK_EQUAL(command.qty, 2);
+
+    BOOST_CHECK_EQUAL(ParseMessage("", command), ParseError_Empty);
+    BOOST_CHECK_EQUAL(ParseMessage("ordr 1 buy 1 1", command), ParseError_UnknownType);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 buy 100", command), ParseError_MissingField);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001  buy 100 12.30", command), ParseError_BadSide);
+    BOOST_CHECK_EQUAL(ParseMessage("order 10x1 buy 100 12.30", command), ParseError_BadNumber);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 buy 100 12.305", command), ParseError_BadPrice);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 buy 100 12.3001", command), ParseError_BadPrice);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 buy 0 12.30", command), ParseError_OutOfRange);
+    BOOST_CHECK_EQUAL(ParseMessage("cancel 99999999999", command), ParseError_OutOfRange);
+    BOOST_CHECK_EQUAL(ParseMessage("q level mid 0", command), ParseError_BadSide);
+
+    int64_t mills;
+    BOOST_CHECK(ParseMills("12.3", mills));
+    BOOST_CHECK_EQUAL(mills, 12300);
+    BOOST_CHECK(ParseMills("0.005", mills));
+    BOOST_CHECK_EQUAL(mills, 5);
+    BOOST_CHECK(ParseMills("1075", mills));
+    BOOST_CHECK_EQUAL(mills, 1075000);
+    BOOST_CHECK(ParseMills("12.1500", mills));
+    BOOST_CHECK_EQUAL(mills, 12150);
+    BOOST_CHECK(ParseMills("12.", mills));
+    BOOST_CHECK_EQUAL(mills, 12000);
+    BOOST_CHECK(!ParseMills("-1", mills));
+    BOOST_CHECK(!ParseMills("1e3", mills));
+}
+
+BOOST_AUTO_TEST_CASE( test_processmessage_invalid ) {
+    OrderBook mgr;
+    stringstream s;
+    mgr.ProcessMessage("order 1001 buy 100 12.305", s);
+    mgr.ProcessMessage("amend 1001", s);
+    mgr.ProcessMessage("q book", s);
+    BOOST_CHECK_EQUAL(boost::trim_copy(s.str()),
+        "Got Invalid Message: order 1001 buy 100 12.305\nGot Invalid Message: amend 1001\nGot Invalid Message: q book");
+    BOOST_CHECK_EQUAL(mgr.GetOrder(1001), nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( test_output_buffer ) {
+    OutputBuffer buffer(4);
+    stringstream expected;
+    for(double px: {0.0, 12.15, 12.3, 1075.0, 0.005, 123456.0, 1234567.0}) {
+        buffer.AppendPx(px);
+        buffer.Append(", ");
+        expected << px << ", ";
+    }
+    buffer.AppendInt(-42);
+    expected << -42;
+    BOOST_CHECK_EQUAL(string(buffer.Data(), buffer.Size()), expected.str());
 }
 
+BOOST_AUTO_TEST_CASE( test_binary_protocol ) {
+    Command command, decoded;
+    BOOST_CHECK_EQUAL(ParseMessage("order 1001 sell 100 12.35", command), ParseError_None);
+    uint8_t wire[sizeof(BinaryCommand)];
+    EncodeCommand(command, wire);
+    BOOST_CHECK_EQUAL(wire[0], 'N');
+    BOOST_CHECK_EQUAL(wire[4] | wire[5] << 8, 1001);
+    BOOST_CHECK(DecodeCommand(wire, decoded));
+    BOOST_CHECK_EQUAL(decoded.type, CommandType_NewOrder);
+    BOOST_CHECK_EQUAL(decoded.side, OrderSide_Sell);
+    BOOST_CHECK_EQUAL(decoded.orderId, 1001);
+    BOOST_CHECK_EQUAL(decoded.qty, 100);
+    BOOST_CHECK_EQUAL(decoded.tick, command.tick);
+
+    wire[0] = 'Z';
+    BOOST_CHECK(!DecodeCommand(wire, decoded));
+
+    OrderBook mgr;
+    mgr.ProcessMessage("order 1001 buy 100 12.3", cout);
+    Reply reply, decodedReply;
+    BOOST_CHECK(ParseMessage("q level bid 0", command) == ParseError_None && mgr.Execute(command, reply));
+    uint8_t replyWire[sizeof(BinaryReply)];
+    EncodeReply(reply, replyWire);
+    DecodeReply(replyWire, decodedReply);
+    OutputBuffer text;
+    FormatReply(decodedReply, text);
+    BOOST_CHECK_EQUAL(string(text.Data(), text.Size()), "bid, 0, 12.3, 100, 1\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_events ) {
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    mgr.NewOrder(10, OrderSide::OrderSide_Sell, 3, 12.30);
+    mgr.NewOrder(11, OrderSide::OrderSide_Sell, 2, 12.40);
+    mgr.NewOrder(12, OrderSide::OrderSide_Buy, 4, 12.40);
+    mgr.NewOrder(13, OrderSide::OrderSide_Buy, 5, 12.00);
+    mgr.AmendOrder(13, 7);
+    mgr.CancelOrder(13);
+
+    OutputBuffer text;
+    for(size_t i = 0; i < events.Size(); ++i) {
+        FormatEvent(events.Data()[i], text);
+    }
+    BOOST_CHECK_EQUAL(string(text.Data(), text.Size()),
+        "fill, 12, 10, 12.3, 3, Filled, PartiallyFilled\n"
+        "fill, 12, 11, 12.4, 1, PartiallyFilled, Filled\n"
+        "amend, 13, 12, 7, New\n"
+        "cancel, 13, 12, 7, Canceled\n");
+
+    events.Clear();
+    mgr.SetEventBuffer(NULL);
+    mgr.NewOrder(14, OrderSide::OrderSide_Buy, 1, 12.40);
+    BOOST_CHECK(events.Empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_book_manager ) {
+    BookManager manager(3, false);
+    OutputBuffer output;
+    const char *messages[] = {
+        "AAA order 1 buy 100 12.3",
+        "BBB order 1 sell 50 7.5",
+        "AAA q order 1",
+        "CCC order 7 sell 10 1.5",
+        "BBB q level ask 0",
+        "AAA bogus",
+        "BBB order 2 buy 20 7.5",
+        "CCC q order 7",
+        "BBB q order 1",
+        "AAA q level bid 0",
+    };
+    for(auto message: messages) {
+        manager.ProcessMessage(message, output);
+    }
+    manager.Flush(output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()),
+        "order, 1, New, 100, 0\n"
+        "ask, 0, 7.5, 50, 1\n"
+        "Got Invalid Message: AAA bogus\n"
+        "order, 7, New, 10, 0\n"
+        "order, 1, PartiallyFilled, 30, 0\n"
+        "bid, 0, 12.3, 100, 1\n");
+    BOOST_CHECK_EQUAL(manager.GetBook("BBB")->GetOrder(2)->status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(manager.GetBook("DDD"), nullptr);
+
+    //stats are formatted by the worker and come back in input order
+    output.Clear();
+    manager.ProcessMessage("BBB q stats", output);
+    manager.ProcessMessage("AAA q order 1", output);
+    manager.Flush(output);
+    OutputBuffer expected;
+    manager.GetBook("BBB")->AppendStats(expected);
+    string stats(expected.Data(), expected.Size()), replies(output.Data(), output.Size());
+    //the latency percentiles are converted from cycles each time, only the counters line is compared
+    BOOST_CHECK_EQUAL(replies.substr(0, replies.find('\n')), stats.substr(0, stats.find('\n')));
+    BOOST_CHECK_EQUAL(count(replies.begin(), replies.end(), '\n'), count(stats.begin(), stats.end(), '\n') + 1);
+    BOOST_CHECK(boost::ends_with(replies, "\norder, 1, New, 100, 0\n"));
+}
+
+BOOST_AUTO_TEST_CASE( test_book_manager_idle ) {
+    //with no traffic the workers back off to sleeps, two of them may not keep a core busy
+    BookManager manager(2, false);
+    OutputBuffer output;
+    manager.ProcessMessage("AAA order 1 buy 100 12.3", output);
+    manager.Flush(output);
+    auto cpu = []() {
+        timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec + now.tv_nsec * 1e-9;
+    };
+    //past the spin and yield phases first
+    this_thread::sleep_for(chrono::milliseconds(50));
+    double start = cpu();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    BOOST_CHECK_LT(cpu() - start, 0.1);
+}
+
+BOOST_AUTO_TEST_CASE( test_depth_cache ) {
+    //the cache must always agree with the orders themselves, also past its depth
+    OrderBook mgr;
+    srand(7);
+    for(int id = 1; id < 1500; ++id) {
+        int action = rand() % 10;
+        if(action < 6) {
+            double px = 10 + (rand() % 40) * 0.01;
+            mgr.NewOrder(id, rand() % 2? OrderSide::OrderSide_Buy: OrderSide::OrderSide_Sell, 1 + rand() % 50, px);
+        } else if(action < 8) {
+            mgr.CancelOrder(rand() % id);
+        } else {
+            mgr.AmendOrder(rand() % id, 1 + rand() % 50);
+        }
+
+        for(OrderSide side: {OrderSide::OrderSide_Buy, OrderSide::OrderSide_Sell}) {
+            std::map<double, std::pair<int, int>> levels;   //best first
+            for(int oid = 1; oid <= id; ++oid) {
+                Order *order = mgr.GetOrder(oid);
+                if(!order || !order->IsActive() || order->side != side) continue;
+                auto &lv = levels[side == OrderSide::OrderSide_Buy? -order->OrderPx(): order->OrderPx()];
+                lv.first += order->OrderQty() - order->CumQty();
+                lv.second += 1;
+            }
+            auto it = levels.begin();
+            for(int level = 0; level < DepthCache::Levels + 3; ++level) {
+                auto cached = mgr.GetLevel(side, level);
+                if(it == levels.end()) {
+                    BOOST_REQUIRE_EQUAL(get<2>(cached), 0);
+                    continue;
+                }
+                BOOST_REQUIRE_CLOSE(get<0>(cached), std::fabs(it->first), 1e-9);
+                BOOST_REQUIRE_EQUAL(get<1>(cached), it->second.first);
+                BOOST_REQUIRE_EQUAL(get<2>(cached), it->second.second);
+                ++it;
+            }
+            BOOST_REQUIRE(mgr.GetDepth(side).Size() <= DepthCache::Levels);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_market_data ) {
+    OrderBook mgr;
+    MarketDataPublisher marketData;
+    mgr.SetMarketDataPublisher(&marketData);
+    mgr.NewOrder(10, OrderSide::OrderSide_Sell, 3, 12.30);
+    mgr.NewOrder(11, OrderSide::OrderSide_Sell, 2, 12.40);
+    mgr.NewOrder(12, OrderSide::OrderSide_Buy, 4, 12.40);
+    mgr.NewOrder(13, OrderSide::OrderSide_Buy, 5, 12.00);
+    mgr.AmendOrder(13, 7);
+    mgr.CancelOrder(13);
+
+    OutputBuffer text;
+    for(size_t i = 0; i < marketData.Size(); ++i) {
+        FormatDepthUpdate(marketData.Data()[i], text);
+    }
+    BOOST_CHECK_EQUAL(string(text.Data(), text.Size()),
+        "depth, ask, 12.3, 3, 1\n"
+        "depth, ask, 12.4, 2, 1\n"
+        "depth, ask, 12.3, 0, 0\n"
+        "depth, ask, 12.4, 1, 1\n"
+        "depth, bid, 12, 5, 1\n"
+        "depth, bid, 12, 7, 1\n"
+        "depth, bid, 12, 0, 0\n");
+
+    //conflated: one update per changed level, in order of first change
+    MarketDataPublisher conflated(true);
+    mgr.SetMarketDataPublisher(&conflated);
+    mgr.NewOrder(20, OrderSide::OrderSide_Buy, 5, 12.00);
+    mgr.NewOrder(21, OrderSide::OrderSide_Buy, 6, 12.00);
+    mgr.NewOrder(22, OrderSide::OrderSide_Sell, 1, 12.50);
+    mgr.AmendOrder(20, 4);
+    BOOST_REQUIRE_EQUAL(conflated.Size(), 2u);
+    BOOST_CHECK_EQUAL(conflated.Data()[0].qty, 10);
+    BOOST_CHECK_EQUAL(conflated.Data()[0].count, 2);
+    BOOST_CHECK_EQUAL(TickToMills(conflated.Data()[1].tick), 12500);
+    BOOST_CHECK_EQUAL(conflated.Data()[1].qty, 1);
+    conflated.Clear();
+    mgr.CancelOrder(22);
+    BOOST_REQUIRE_EQUAL(conflated.Size(), 1u);
+    BOOST_CHECK_EQUAL(conflated.Data()[0].qty, 0);
+
+    //snapshot: bids best first, then asks
+    conflated.Clear();
+    conflated.Snapshot(mgr);
+    text.Clear();
+    for(size_t i = 0; i < conflated.Size(); ++i) {
+        FormatDepthUpdate(conflated.Data()[i], text);
+    }
+    BOOST_CHECK_EQUAL(string(text.Data(), text.Size()),
+        "snapshot, 1, 1\n"
+        "level, bid, 12, 10, 2\n"
+        "level, ask, 12.4, 1, 1\n");
+
+    uint8_t wire[sizeof(BinaryDepthUpdate)];
+    DepthUpdate update;
+    EncodeDepthUpdate(conflated.Data()[2], wire);
+    DecodeDepthUpdate(wire, update);
+    BOOST_CHECK_EQUAL(update.type, DepthUpdateType_Level);
+    BOOST_CHECK_EQUAL(update.side, OrderSide::OrderSide_Sell);
+    BOOST_CHECK_EQUAL(TickToMills(update.tick), 12400);
+    BOOST_CHECK_EQUAL(update.qty, 1);
+    BOOST_CHECK_EQUAL(update.count, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_market_data_uncrossed ) {
+    //an aggressor trades before what is left of it rests, so the feed never shows a crossed book, not even for one update
+    OrderFlowConfig config;
+    config.seed = 5;
+    config.aggressivePct = 20;
+    OrderFlowGenerator flow(config);
+    OrderBook mgr;
+    MarketDataPublisher marketData;
+    mgr.SetMarketDataPublisher(&marketData);
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    map<Tick, int> bids, asks;
+    Command command;
+    Reply reply;
+    int crossed = 0, fills = 0;
+    for(int i = 0; i < 20000; ++i) {
+        flow.Next(command);
+        mgr.Execute(command, reply);
+        for(size_t j = 0; j < marketData.Size(); ++j) {
+            const DepthUpdate &update = marketData.Data()[j];
+            auto &levels = update.side == OrderSide::OrderSide_Buy? bids: asks;
+            if(update.qty) levels[update.tick] = update.qty; else levels.erase(update.tick);
+            if(!bids.empty() && !asks.empty() && bids.rbegin()->first >= asks.begin()->first) ++crossed;
+        }
+        marketData.Clear();
+        for(size_t j = 0; j < events.Size(); ++j) fills += events.Data()[j].type == EventType_Fill;
+        events.Clear();
+    }
+    BOOST_CHECK_EQUAL(crossed, 0);
+    BOOST_CHECK(fills > 1000);
+}
+
+BOOST_AUTO_TEST_CASE( test_order_flow ) {
+    OrderFlowConfig config;
+    config.seed = 42;
+    OrderFlowGenerator a(config), b(config);
+    OrderBook mgr;
+    int counts[256] = {};
+    for(int i = 0; i < 10000; ++i) {
+        Command x, y;
+        a.Next(x);
+        b.Next(y);
+        BOOST_REQUIRE(x.type == y.type && x.orderId == y.orderId && x.qty == y.qty);
+        if(x.type == CommandType_NewOrder) BOOST_REQUIRE_EQUAL(x.tick, y.tick);
+        ++counts[x.type];
+
+        //every generated message is valid and survives the text protocol
+        OutputBuffer text;
+        FormatCommand(x, text);
+        Command parsed;
+        BOOST_REQUIRE_EQUAL(ParseMessage(string_view(text.Data(), text.Size() - 1), parsed), ParseError_None);
+        Reply reply{};
+        mgr.Execute(x, reply);
+        BOOST_REQUIRE(reply.type != ReplyType_Invalid);
+    }
+    //roughly the configured mix
+    BOOST_CHECK(counts[CommandType_NewOrder] > 5000 && counts[CommandType_NewOrder] < 7000);
+    BOOST_CHECK(counts[CommandType_Cancel] > 1500);
+    BOOST_CHECK(counts[CommandType_QueryLevel] + counts[CommandType_QueryOrder] > 200);
+}
+
+BOOST_AUTO_TEST_CASE( test_stats ) {
+    Histogram histogram;
+    for(uint64_t v = 1; v <= 1000; ++v) histogram.Add(v);
+    BOOST_CHECK_EQUAL(histogram.Count(), 1000u);
+    BOOST_CHECK_EQUAL(histogram.Max(), 1000u);
+    //bucket resolution is 1/16 of the power of 2
+    BOOST_CHECK(histogram.Percentile(0.5) >= 500 && histogram.Percentile(0.5) < 500 + 32);
+    BOOST_CHECK(histogram.Percentile(0.99) >= 990 && histogram.Percentile(0.99) <= 1000);
+    BOOST_CHECK_EQUAL(histogram.Percentile(1), 1000u);
+    BOOST_CHECK_EQUAL(Histogram().Percentile(0.5), 0u);
+
+    OrderBook mgr;
+    OutputBuffer output;
+    for(const char *message: {"order 1 sell 10 12.3", "order 2 sell 10 12.4", "order 3 buy 15 12.4",
+                              "order 3 buy 15 12.4", "cancel 9", "bogus", "q level ask 0"}) {
+        mgr.ProcessMessage(message, output);
+    }
+    output.Clear();
+    mgr.ProcessMessage("q stats", output);
+    string stats(output.Data(), output.Size());
+#ifdef ORDERBOOK_STATS
+    BOOST_CHECK_EQUAL(stats.substr(0, stats.find('\n')), "stats, messages, 6, invalid, 1, rejected, 2, fills, 2");
+    BOOST_CHECK(stats.find("stats, order, 4, parse, ") != string::npos);
+    BOOST_CHECK(stats.find("stats, level, 1, parse, ") != string::npos);
+    BOOST_CHECK(stats.find("stats, levels per match, 1, 2, 2, 2, 2\n") != string::npos);
+    BOOST_CHECK_EQUAL(mgr.GetStats().newOrder.match.Count(), 4u);
+#else
+    BOOST_CHECK_EQUAL(stats, "stats, disabled\n");
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( test_match_sweep ) {
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    int id = 1;
+    for(int px = 100; px < 110; ++px) {
+        for(int i = 0; i < 3; ++i) mgr.NewOrder(id++, OrderSide::OrderSide_Sell, 10, px);
+    }
+
+    //two whole levels and half of the third, the rest of the book is not touched
+    mgr.NewOrder(100, OrderSide::OrderSide_Buy, 75, 200);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(100)->status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(events.Size(), 8u);
+    BOOST_CHECK_EQUAL(events.Data()[7].restingId, 8);
+    BOOST_CHECK_EQUAL(events.Data()[7].qty, 5);
+    BOOST_CHECK_EQUAL(events.Data()[7].aggressorStatus, OrderStatus_Filled);
+    for(int i = 1; i <= 7; ++i) BOOST_CHECK_EQUAL(mgr.GetOrder(i)->status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(8)->status, OrderStatus_PartiallyFilled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(9)->status, OrderStatus_New);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(102.0, 15, 2));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 1) == make_tuple(103.0, 30, 3));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(0.0, 0, 0));
+
+    //exactly the rest of a level, then the aggressor rests behind the first level it can't cross
+    events.Clear();
+    mgr.NewOrder(101, OrderSide::OrderSide_Buy, 15, 102);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(101)->status, OrderStatus_Filled);
+    mgr.NewOrder(102, OrderSide::OrderSide_Buy, 40, 103);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(102)->status, OrderStatus_PartiallyFilled);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(103.0, 10, 1));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(104.0, 30, 3));
+    BOOST_CHECK_EQUAL(events.Size(), 5u);
+
+    //the partially filled order keeps the front of its queue
+    mgr.NewOrder(103, OrderSide::OrderSide_Buy, 5, 104);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(103)->status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(13)->status, OrderStatus_PartiallyFilled);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(104.0, 25, 3));
+    OutputBuffer output;
+    mgr.ProcessMessage("q order 14", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "order, 14, New, 10, 1\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_match_sweep_fill_reports ) {
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    for(int id = 1; id <= 3; ++id) mgr.NewOrder(id, OrderSide::OrderSide_Sell, 100, 12.30);
+
+    //the whole level goes, every fill reports the aggressor as it stands right after that fill
+    mgr.NewOrder(10, OrderSide::OrderSide_Buy, 300, 12.30);
+    BOOST_REQUIRE_EQUAL(events.Size(), 3u);
+    int leaves = 300;
+    const int expectedLeaves[] = {200, 100, 0};
+    const OrderStatus expectedStatus[] = {OrderStatus_PartiallyFilled, OrderStatus_PartiallyFilled, OrderStatus_Filled};
+    for(int i = 0; i < 3; ++i) {
+        const Event &event = events.Data()[i];
+        BOOST_CHECK_EQUAL(event.type, EventType_Fill);
+        BOOST_CHECK_EQUAL(event.restingId, i + 1);
+        BOOST_CHECK_EQUAL(event.status, OrderStatus_Filled);
+        leaves -= event.qty;
+        BOOST_CHECK_EQUAL(leaves, expectedLeaves[i]);
+        BOOST_CHECK_EQUAL(event.aggressorStatus, expectedStatus[i]);
+    }
+    BOOST_CHECK_EQUAL(mgr.GetOrder(10)->leavesQty, 0);
+
+    //same through the text feed
+    for(int id = 4; id <= 6; ++id) mgr.NewOrder(id, OrderSide::OrderSide_Sell, 100, 12.30);
+    events.Clear();
+    OutputBuffer output;
+    mgr.ProcessMessage("order 11 buy 300 12.3", output);
+    output.Clear();
+    for(size_t i = 0; i < events.Size(); ++i) FormatEvent(events.Data()[i], output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()),
+                      "fill, 11, 4, 12.3, 100, Filled, PartiallyFilled\n"
+                      "fill, 11, 5, 12.3, 100, Filled, PartiallyFilled\n"
+                      "fill, 11, 6, 12.3, 100, Filled, Filled\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_journal ) {
+    char path[] = "/tmp/order_book_journal_XXXXXX";
+    close(mkstemp(path));
+    const char *messages[] = {"order 1 sell 10 12.3", "order 2 sell 10 12.4", "q level ask 0", "order 3 buy 15 12.4",
+                              "amend 2 8", "bogus", "order 4 buy 7 12.1", "cancel 4", "order 5 buy 1 12.0"};
+    OrderBook live;
+    {
+        //small capacity, so appending has to grow the file
+        Journal journal;
+        BOOST_REQUIRE(journal.Open(path, false, Journal::HeaderSize + 2 * sizeof(BinaryCommand)));
+        live.SetJournal(&journal);
+        OutputBuffer output;
+        for(const char *message: messages) live.ProcessMessage(message, output);
+        BOOST_CHECK(journal.Commit());
+        BOOST_CHECK_EQUAL(journal.Records(), 7u);
+    }
+
+    OrderBook recovered;
+    Journal journal;
+    BOOST_REQUIRE(journal.Open(path));
+    BOOST_CHECK_EQUAL(journal.Replay(recovered), 7u);
+    for(int id = 1; id <= 5; ++id) {
+        BOOST_CHECK_EQUAL(recovered.GetOrder(id)->status, live.GetOrder(id)->status);
+        BOOST_CHECK_EQUAL(recovered.GetOrder(id)->CumQty(), live.GetOrder(id)->CumQty());
+    }
+    BOOST_CHECK(recovered.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.4, 3, 1));
+    BOOST_CHECK(recovered.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.0, 1, 1));
+
+    //appending continues behind the recovered records
+    recovered.SetJournal(&journal);
+    Command cancel;
+    cancel.type = CommandType_Cancel;
+    cancel.orderId = 5;
+    Reply reply;
+    BOOST_CHECK(!recovered.Execute(cancel, reply));
+    BOOST_CHECK_EQUAL(journal.Records(), 8u);
+    journal.Close();
+    BOOST_REQUIRE(journal.Open(path));
+    BOOST_CHECK_EQUAL(journal.Records(), 8u);
+    journal.Close();
+
+    //not a journal: refused and left alone
+    FILE *file = fopen(path, "w");
+    fputs("order 1 buy 1 1\n", file);
+    fclose(file);
+    BOOST_CHECK(!journal.Open(path));
+    unlink(path);
+}
+
+BOOST_AUTO_TEST_CASE( test_journal_invalid_command ) {
+    char path[] = "/tmp/order_book_journal_XXXXXX";
+    close(mkstemp(path));
+    Command command;
+    Reply reply;
+    command.type = CommandType_NewOrder;
+    command.side = OrderSide::OrderSide_Buy;
+    PxToTick(12.30, command.tick);
+    {
+        Journal journal;
+        BOOST_REQUIRE(journal.Open(path));
+        OrderBook live;
+        live.SetJournal(&journal);
+        for(int id = 1; id <= 3; ++id) {
+            command.orderId = id;
+            //the second one has no qty, the wire format can't carry it
+            command.qty = id == 2? 0: 10;
+            bool replied = live.Execute(command, reply);
+            BOOST_CHECK_EQUAL(replied, id == 2);
+        }
+        BOOST_CHECK_EQUAL(reply.type, ReplyType_Invalid);
+        BOOST_CHECK(live.GetOrder(2) == nullptr);
+        BOOST_CHECK(journal.Commit());
+        BOOST_CHECK_EQUAL(journal.Records(), 2u);
+    }
+
+    //the records behind the refused command are still there after a reopen, and appending goes on behind them
+    Journal journal;
+    BOOST_REQUIRE(journal.Open(path));
+    BOOST_CHECK_EQUAL(journal.Records(), 2u);
+    OrderBook recovered;
+    BOOST_CHECK_EQUAL(journal.Replay(recovered), 2u);
+    BOOST_CHECK(recovered.GetOrder(1) != nullptr && recovered.GetOrder(3) != nullptr);
+    BOOST_CHECK(recovered.GetOrder(2) == nullptr);
+    BOOST_CHECK(recovered.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.3, 20, 2));
+    journal.Close();
+    unlink(path);
+}
+
+BOOST_AUTO_TEST_CASE( test_snapshot ) {
+    char path[] = "/tmp/order_book_snapshot_XXXXXX";
+    close(mkstemp(path));
+    char journalPath[] = "/tmp/order_book_journal_XXXXXX";
+    close(mkstemp(journalPath));
+
+    const char *before[] = {"order 1 sell 10 12.3", "order 2 sell 10 12.3", "order 3 sell 10 12.3", "order 4 sell 5 12.5",
+                            "order 5 buy 12 12.3", "cancel 3", "order 6 sell 7 12.3", "order 7 buy 20 12.0",
+                            "order 8 buy 1 12.1", "amend 8 4", "amend 2 9"};
+    const char *after[] = {"order 9 buy 30 12.5", "order 10 sell 2 12.0", "amend 7 25", "order 11 sell 100 11.0"};
+    const char *queries[] = {"q level ask 0", "q level ask 1", "q level bid 0", "q level bid 1", "q order 1", "q order 2",
+                             "q order 3", "q order 4", "q order 6", "q order 7", "q order 8", "q order 9", "q order 11"};
+
+    OrderBook live;
+    OutputBuffer liveOutput;
+    {
+        Journal journal;
+        BOOST_REQUIRE(journal.Open(journalPath));
+        live.SetJournal(&journal);
+        live.SetSnapshotFile(path);
+        for(const char *message: before) live.ProcessMessage(message, liveOutput);
+        live.ProcessMessage("snapshot", liveOutput);
+        for(const char *message: after) live.ProcessMessage(message, liveOutput);
+        BOOST_CHECK(journal.Commit());
+        BOOST_CHECK_EQUAL(journal.Records(), 15u);
+        live.SetJournal(NULL);
+    }
+    BOOST_CHECK(liveOutput.Empty());
+
+    //snapshot alone: the book as it was when the snapshot was taken
+    OrderBook restored;
+    uint64_t journalRecords = 0;
+    BOOST_REQUIRE(restored.LoadSnapshot(path, journalRecords));
+    BOOST_CHECK_EQUAL(journalRecords, 11u);
+    BOOST_CHECK(restored.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.3, 14, 2));
+    BOOST_CHECK(restored.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.1, 4, 1));
+    BOOST_CHECK_EQUAL(restored.GetOrder(1)->status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(restored.GetOrder(3)->status, OrderStatus_Canceled);
+
+    //snapshot plus the journal tail: the same book as the live one, queues included
+    Journal journal;
+    BOOST_REQUIRE(journal.Open(journalPath));
+    BOOST_CHECK_EQUAL(journal.Replay(restored, journalRecords), 4u);
+    OutputBuffer expected, actual;
+    for(const char *query: queries) {
+        live.ProcessMessage(query, expected);
+        restored.ProcessMessage(query, actual);
+    }
+    BOOST_CHECK_EQUAL(string(actual.Data(), actual.Size()), string(expected.Data(), expected.Size()));
+    for(int i = 0; i < 2; ++i) BOOST_CHECK(restored.GetDepth(OrderSide::OrderSide_Buy)[i].tick == live.GetDepth(OrderSide::OrderSide_Buy)[i].tick);
+
+    //not a snapshot
+    OrderBook other;
+    BOOST_CHECK(!other.LoadSnapshot(journalPath, journalRecords));
+    unlink(path);
+    unlink(journalPath);
+}
+
+BOOST_AUTO_TEST_CASE( test_amend_price ) {
+    Command command;
+    BOOST_CHECK_EQUAL(ParseMessage("amend 7 30 12.35", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.type, CommandType_Amend);
+    BOOST_CHECK_EQUAL(command.qty, 30);
+    Tick tick;
+    BOOST_REQUIRE(MillsToTick(12350, tick));
+    BOOST_CHECK_EQUAL(command.tick, tick);
+    BOOST_CHECK_EQUAL(ParseMessage("amend 7 30 12.3501", command), ParseError_BadPrice);
+    BOOST_CHECK_EQUAL(ParseMessage("amend 7 30", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.tick, InvalidTick);
+
+    //the price survives the binary protocol, no price stays no price
+    uint8_t wire[sizeof(BinaryCommand)];
+    Command decoded;
+    ParseMessage("amend 7 30 12.35", command);
+    EncodeCommand(command, wire);
+    BOOST_CHECK(DecodeCommand(wire, decoded));
+    BOOST_CHECK_EQUAL(decoded.tick, command.tick);
+    ParseMessage("amend 7 30", command);
+    EncodeCommand(command, wire);
+    BOOST_CHECK(DecodeCommand(wire, decoded));
+    BOOST_CHECK_EQUAL(decoded.tick, InvalidTick);
+
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    mgr.NewOrder(1, OrderSide::OrderSide_Sell, 10, 12.5);
+    mgr.NewOrder(2, OrderSide::OrderSide_Sell, 10, 12.5);
+    mgr.NewOrder(3, OrderSide::OrderSide_Sell, 10, 12.6);
+    mgr.NewOrder(4, OrderSide::OrderSide_Buy, 10, 12.0);
+    mgr.NewOrder(5, OrderSide::OrderSide_Buy, 10, 12.0);
+
+    //qty down keeps the place in the queue
+    mgr.AmendOrder(4, 6);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.0, 16, 2));
+    OutputBuffer output;
+    mgr.ProcessMessage("q order 4", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "order, 4, New, 6, 0\n");
+
+    //a passive price change moves the order to the back of the new level
+    mgr.AmendOrder(1, 10, 12.6);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.5, 10, 1));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 1) == make_tuple(12.6, 20, 2));
+    output.Clear();
+    mgr.ProcessMessage("q order 1", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "order, 1, New, 10, 1\n");
+
+    //an aggressive one trades like a new order would, keeping the id
+    events.Clear();
+    mgr.ProcessMessage("amend 5 15 12.5", output);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(5)->status, OrderStatus_PartiallyFilled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(5)->CumQty(), 10);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(5)->OrderPx(), 12.5);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(2)->status, OrderStatus_Filled);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.5, 5, 1));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 1) == make_tuple(12.0, 6, 1));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.6, 20, 2));
+    BOOST_CHECK_EQUAL(events.Size(), 2u);
+    BOOST_CHECK_EQUAL(events.Data()[0].type, EventType_Amend);
+    BOOST_CHECK_EQUAL(events.Data()[1].type, EventType_Fill);
+    BOOST_CHECK_EQUAL(events.Data()[1].restingId, 2);
+
+    //a new qty at or below what already traded finishes the order wherever the price goes
+    mgr.AmendOrder(5, 10, 12.7);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(5)->status, OrderStatus_Filled);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.0, 6, 1));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.6, 20, 2));
+}
+
+BOOST_AUTO_TEST_CASE( test_order_types ) {
+    Command command;
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 buy 10 12.3 ioc", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.tif, TimeInForce_IOC);
+    BOOST_CHECK_EQUAL(command.orderType, OrderType_Limit);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 buy 10 12.3 post", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.orderType, OrderType_PostOnly);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 sell 10 market fok", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.orderType, OrderType_Market);
+    BOOST_CHECK_EQUAL(command.tif, TimeInForce_FOK);
+    BOOST_CHECK_EQUAL(command.tick, InvalidTick);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 sell 10 market post", command), ParseError_UnknownType);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 sell 10 12.3 gtc", command), ParseError_UnknownType);
+
+    for(const char *message: {"order 1 buy 10 12.3", "order 1 buy 10 12.3 ioc", "order 1 buy 10 12.3 fok",
+                              "order 1 buy 10 12.3 post", "order 1 buy 10 market", "order 1 buy 10 market fok"}) {
+        uint8_t wire[sizeof(BinaryCommand)];
+        Command decoded;
+        OutputBuffer text;
+        ParseMessage(message, command);
+        EncodeCommand(command, wire);
+        BOOST_CHECK(DecodeCommand(wire, decoded));
+        FormatCommand(decoded, text);
+        BOOST_CHECK_EQUAL(string(text.Data(), text.Size()), string(message) + "\n");
+    }
+
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    mgr.NewOrder(1, OrderSide::OrderSide_Sell, 10, 12.5);
+    mgr.NewOrder(2, OrderSide::OrderSide_Sell, 10, 12.6);
+    mgr.NewOrder(3, OrderSide::OrderSide_Buy, 10, 12.0);
+
+    //IOC takes what crosses and the rest is canceled, it never rests
+    events.Clear();
+    mgr.NewOrder(10, OrderSide::OrderSide_Buy, 15, 12.5, OrderType_Limit, TimeInForce_IOC);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(10)->status, OrderStatus_Canceled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(10)->CumQty(), 10);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.0, 10, 1));
+    BOOST_REQUIRE_EQUAL(events.Size(), 2u);
+    BOOST_CHECK_EQUAL(events.Data()[1].type, EventType_Cancel);
+    BOOST_CHECK_EQUAL(events.Data()[1].qty, 5);
+
+    //FOK: all or nothing, nothing is touched when it can't fill
+    mgr.NewOrder(11, OrderSide::OrderSide_Buy, 11, 13.0, OrderType_Limit, TimeInForce_FOK);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(11)->status, OrderStatus_Rejected);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.6, 10, 1));
+    mgr.NewOrder(12, OrderSide::OrderSide_Buy, 10, 13.0, OrderType_Limit, TimeInForce_FOK);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(12)->status, OrderStatus_Filled);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(0.0, 0, 0));
+
+    //post-only rests unless it would trade
+    mgr.NewOrder(13, OrderSide::OrderSide_Sell, 5, 12.0, OrderType_PostOnly);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(13)->status, OrderStatus_Rejected);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.0, 10, 1));
+    mgr.NewOrder(14, OrderSide::OrderSide_Sell, 5, 12.1, OrderType_PostOnly);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(14)->status, OrderStatus_New);
+    mgr.AmendOrder(14, 5, 12.0);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(12.1, 5, 1));
+
+    //market orders walk the book at any price
+    events.Clear();
+    mgr.ProcessMessage("order 15 sell 12 market", cout);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(15)->status, OrderStatus_Canceled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(15)->CumQty(), 10);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(0.0, 0, 0));
+    OutputBuffer text;
+    FormatEvent(events.Data()[events.Size() - 1], text);
+    BOOST_CHECK_EQUAL(string(text.Data(), text.Size()), "cancel, 15, 0, 2, Canceled\n");
+    mgr.NewOrder(16, OrderSide::OrderSide_Buy, 5, 0, OrderType_Market, TimeInForce_FOK);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(16)->status, OrderStatus_Filled);
+}
+
+BOOST_AUTO_TEST_CASE( test_book_view ) {
+    OrderBook mgr;
+    BookViewPublisher publisher;
+    mgr.SetBookView(&publisher);
+    BookViewReader reader(publisher.Shared());
+    BookView view;
+    reader.Read(view);
+    BOOST_CHECK_EQUAL(view.bidLevels, 0);
+    uint64_t version = view.version;
+
+    OutputBuffer output;
+    mgr.ProcessMessage("order 1 buy 10 12.0", output);
+    mgr.ProcessMessage("order 2 sell 5 12.5", output);
+    BOOST_REQUIRE(reader.TryRead(view));
+    BOOST_CHECK_EQUAL(view.version, version + 2);
+    BOOST_CHECK_EQUAL(view.bidLevels, 1);
+    BOOST_CHECK_EQUAL(view.askLevels, 1);
+    BOOST_CHECK_EQUAL(view.bids[0].qty, 10);
+    BOOST_CHECK_EQUAL(view.asks[0].count, 1);
+
+    //queries and changes behind the published levels don't publish
+    version = view.version;
+    int levels = DepthCache::Levels;
+    for(int i = 0; i < levels; ++i) {
+        mgr.ProcessMessage("order " + to_string(10 + i) + " buy 1 11." + to_string(9 - i), output);
+    }
+    mgr.ProcessMessage("q level bid 3", output);
+    reader.Read(view);
+    BOOST_CHECK_EQUAL(view.version, version + levels - 1);
+    BOOST_CHECK_EQUAL(view.bidLevels, levels);
+
+    //readers on another thread only ever see whole, uncrossed books
+    OrderBook book;
+    BookViewPublisher shared;
+    book.SetBookView(&shared);
+    atomic<bool> done(false);
+    long reads = 0, bad = 0;
+    thread readerThread([&]() {
+        BookViewReader threadReader(shared.Shared());
+        BookView copy;
+        uint64_t last = 0;
+        do {
+            threadReader.Read(copy);
+            ++reads;
+            if(copy.version < last) ++bad;
+            last = copy.version;
+            for(int i = 1; i < copy.bidLevels; ++i) if(copy.bids[i].tick >= copy.bids[i - 1].tick) ++bad;
+            for(int i = 1; i < copy.askLevels; ++i) if(copy.asks[i].tick <= copy.asks[i - 1].tick) ++bad;
+            if(copy.bidLevels && copy.askLevels && copy.bids[0].tick >= copy.asks[0].tick) ++bad;
+        } while(!done.load(memory_order_acquire));
+    });
+    OrderFlowConfig config;
+    config.seed = 7;
+    OrderFlowGenerator flow(config);
+    Command command;
+    Reply reply;
+    for(int i = 0; i < 200000; ++i) {
+        flow.Next(command);
+        book.Execute(command, reply);
+    }
+    done.store(true, memory_order_release);
+    readerThread.join();
+    BOOST_CHECK(reads > 0);
+    BOOST_CHECK_EQUAL(bad, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_transport ) {
+    string name = "/orderbook_test_" + to_string(getpid());
+    ShmTransport server;
+    BOOST_REQUIRE(server.Create(name.c_str(), 8));
+    ShmClient client;
+    BOOST_REQUIRE(client.Connect(name.c_str()));
+    ShmTransport::Unlink(name.c_str());
+
+    //more commands than the ring holds, so both indexes wrap around
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    OutputBuffer replies, eventRecords;
+    Reply reply;
+    Tick tick;
+    PxToTick(12.0, tick);
+    for(int i = 0; i < 20; ++i) {
+        Command command = {CommandType_NewOrder, i % 2? OrderSide::OrderSide_Sell: OrderSide::OrderSide_Buy, i + 1, 10, tick};
+        client.Send(command);
+        size_t count;
+        const uint8_t *records = server.Commands().Peek(count);
+        for(size_t j = 0; j < count; ++j) {
+            Command decoded;
+            BOOST_REQUIRE(DecodeCommand(records + j * ShmRing::RecordSize, decoded));
+            Reply result;
+            if(mgr.Execute(decoded, result)) {
+                EncodeReply(result, replies.Claim(sizeof(BinaryReply)));
+                replies.Commit(sizeof(BinaryReply));
+            }
+        }
+        server.Commands().Consume(count);
+        size_t pending = replies.Size() / ShmRing::RecordSize;
+        BOOST_REQUIRE_EQUAL(server.Replies().PushSome((const uint8_t *)replies.Data(), pending), pending);
+        replies.Clear();
+    }
+    //new orders are not answered
+    BOOST_CHECK(!client.PollReply(reply));
+    BOOST_CHECK_EQUAL(mgr.GetOrder(20)->status, OrderStatus_Filled);
+
+    //a full ring takes what fits
+    client.Send({CommandType_QueryOrder, OrderSide::OrderSide_Buy, 1, 0, 0});
+    size_t count;
+    const uint8_t *records = server.Commands().Peek(count);
+    BOOST_REQUIRE_EQUAL(count, 1);
+    Command query;
+    DecodeCommand(records, query);
+    server.Commands().Consume(count);
+    BOOST_REQUIRE(mgr.Execute(query, reply));
+    for(int i = 0; i < 10; ++i) {
+        EncodeReply(reply, replies.Claim(sizeof(BinaryReply)));
+        replies.Commit(sizeof(BinaryReply));
+    }
+    BOOST_CHECK_EQUAL(server.Replies().PushSome((const uint8_t *)replies.Data(), 10), 8);
+    BOOST_CHECK_EQUAL(server.Replies().PushSome((const uint8_t *)replies.Data(), 10), 0);
+    client.WaitReply(reply);
+    BOOST_CHECK_EQUAL(reply.type, ReplyType_Order);
+    BOOST_CHECK_EQUAL(reply.id, 1);
+    BOOST_CHECK_EQUAL(reply.status, OrderStatus_Filled);
+    BOOST_CHECK_EQUAL(server.Replies().PushSome((const uint8_t *)replies.Data(), 2), 1);
+
+    //events travel the same way, the book side publishes them in one go
+    BOOST_REQUIRE(events.Size() >= 4);
+    for(size_t i = 0; i < 4; ++i) {
+        EncodeEvent(events.Data()[i], eventRecords.Claim(sizeof(BinaryEvent)));
+        eventRecords.Commit(sizeof(BinaryEvent));
+    }
+    BOOST_CHECK_EQUAL(server.Events().PushSome((const uint8_t *)eventRecords.Data(), 4), 4);
+    Event event;
+    int polled = 0;
+    while(client.PollEvent(event)) ++polled;
+    BOOST_CHECK_EQUAL(polled, 4);
+
+    BOOST_CHECK(!server.IsShutdown());
+    client.Close();
+    BOOST_CHECK(server.IsShutdown());
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_backpressure ) {
+    //the gateway sends many rings' worth of commands before it reads anything, while the book blocks on full
+    //reply and event rings like order_book does, Send has to drain them or both sides stall
+    string name = "/orderbook_test_bp_" + to_string(getpid());
+    ShmTransport server;
+    BOOST_REQUIRE(server.Create(name.c_str(), 8));
+    ShmClient client;
+    BOOST_REQUIRE(client.Connect(name.c_str(), true));
+    ShmTransport::Unlink(name.c_str());
+
+    atomic<bool> stopped{false};
+    thread book([&server, &stopped]() {
+        OrderBook mgr;
+        EventBuffer events;
+        OutputBuffer replies, eventRecords;
+        WaitStrategy wait;
+        for(;;) {
+            bool done = server.IsShutdown();
+            size_t count;
+            const uint8_t *records = server.Commands().Peek(count);
+            if(!count) {
+                if(done) break;
+                wait.Idle();
+                continue;
+            }
+            if(server.EventsSubscribed()) mgr.SetEventBuffer(&events);
+            for(size_t i = 0; i < count; ++i) {
+                Command command;
+                Reply reply;
+                DecodeCommand(records + i * ShmRing::RecordSize, command);
+                if(mgr.Execute(command, reply)) {
+                    EncodeReply(reply, replies.Claim(sizeof(BinaryReply)));
+                    replies.Commit(sizeof(BinaryReply));
+                }
+            }
+            server.Commands().Consume(count);
+            for(size_t i = 0; i < events.Size(); ++i) {
+                EncodeEvent(events.Data()[i], eventRecords.Claim(sizeof(BinaryEvent)));
+                eventRecords.Commit(sizeof(BinaryEvent));
+            }
+            events.Clear();
+            server.Events().PushAll((const uint8_t *)eventRecords.Data(), eventRecords.Size() / ShmRing::RecordSize, wait);
+            server.Replies().PushAll((const uint8_t *)replies.Data(), replies.Size() / ShmRing::RecordSize, wait);
+            eventRecords.Clear();
+            replies.Clear();
+        }
+        stopped.store(true);
+    });
+
+    Tick tick;
+    PxToTick(12.0, tick);
+    for(int i = 0; i < 300; ++i) {
+        client.Send({CommandType_NewOrder, i % 2? OrderSide::OrderSide_Sell: OrderSide::OrderSide_Buy, i + 1, 10, tick});
+        client.Send({CommandType_QueryOrder, OrderSide::OrderSide_Buy, i + 1, 0, 0});
+    }
+    client.Close();
+
+    int replies = 0, fills = 0, lastId = 0;
+    Reply reply;
+    Event event;
+    for(;;) {
+        bool finished = stopped.load();
+        bool got = false;
+        while(client.PollReply(reply)) {
+            BOOST_CHECK_EQUAL(reply.id, ++lastId);
+            ++replies;
+            got = true;
+        }
+        while(client.PollEvent(event)) {
+            fills += event.type == EventType_Fill;
+            got = true;
+        }
+        if(finished && !got) break;
+    }
+    book.join();
+    BOOST_CHECK_EQUAL(replies, 300);
+    BOOST_CHECK_EQUAL(fills, 150);
+}
+
+BOOST_AUTO_TEST_CASE( test_order_layout ) {
+    //cold parts stay with their orders across slabs and through matching
+    OrderBook mgr;
+    int count = (int)OrderPool::SlabSize + 100;
+    for(int i = 0; i < count; ++i) {
+        mgr.NewOrder(i + 1, OrderSide::OrderSide_Sell, i % 7 + 1, 100 + i % 5);
+    }
+    for(int i = 0; i < count; ++i) {
+        Order *order = mgr.GetOrder(i + 1);
+        BOOST_REQUIRE(order);
+        BOOST_CHECK_EQUAL(order->OrderQty(), i % 7 + 1);
+        BOOST_CHECK_EQUAL(order->OrderPx(), 100 + i % 5);
+        BOOST_CHECK_EQUAL(order->leavesQty, order->OrderQty());
+    }
+    OutputBuffer output;
+    mgr.ProcessMessage("q order " + to_string(count), output);
+    int leaves = (count - 1) % 7 + 1, position = (count - 1) / 5;
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()),
+                      "order, " + to_string(count) + ", New, " + to_string(leaves) + ", " + to_string(position) + "\n");
+
+    mgr.NewOrder(count + 1, OrderSide::OrderSide_Buy, 3, 100);
+    Order *first = mgr.GetOrder(1);
+    BOOST_CHECK_EQUAL(first->CumQty(), 1);
+    BOOST_CHECK_EQUAL(first->GetStatusString(), "Filled");
+    Order *sixth = mgr.GetOrder(6);
+    BOOST_CHECK_EQUAL(sixth->CumQty(), 2);
+    BOOST_CHECK_EQUAL(sixth->leavesQty, 4);
+    BOOST_CHECK_EQUAL(sixth->GetStatusString(), "PartiallyFilled");
+
+    //amending below the filled qty finishes the order
+    mgr.AmendOrder(6, 2);
+    BOOST_CHECK_EQUAL(sixth->OrderQty(), 2);
+    BOOST_CHECK_EQUAL(sixth->CumQty(), 2);
+    BOOST_CHECK_EQUAL(sixth->status, OrderStatus_Filled);
+}
+
+BOOST_AUTO_TEST_CASE( test_ladder_sides ) {
+    //same operations, mirrored orderings
+    OrderPool pool;
+    BidLadder bids;
+    AskLadder asks;
+    for(Tick tick: {100, 102, 101}) {
+        Order *bid = pool.Alloc();
+        bid->leavesQty = 1;
+        bids.Push(bid, tick);
+        Order *ask = pool.Alloc();
+        ask->leavesQty = 1;
+        asks.Push(ask, tick);
+    }
+    BOOST_CHECK_EQUAL(bids.BestTick(), 102);
+    BOOST_CHECK_EQUAL(bids.NextTick(102), 101);
+    BOOST_CHECK_EQUAL(bids.NextTick(100), InvalidTick);
+    BOOST_CHECK_EQUAL(asks.BestTick(), 100);
+    BOOST_CHECK_EQUAL(asks.NextTick(100), 101);
+    BOOST_CHECK_EQUAL(asks.NextTick(102), InvalidTick);
+
+    //a sell at 101 takes bids at 101 and better, a buy at 101 takes asks at 101 and better
+    BOOST_CHECK(bids.Crosses(102, 101) && bids.Crosses(101, 101) && !bids.Crosses(100, 101));
+    BOOST_CHECK(asks.Crosses(100, 101) && asks.Crosses(101, 101) && !asks.Crosses(102, 101));
+
+    pool.Free(bids.TakeAll(102));
+    pool.Free(asks.TakeAll(100));
+    BOOST_CHECK_EQUAL(bids.BestTick(), 101);
+    BOOST_CHECK_EQUAL(asks.BestTick(), 101);
+}
+
+static string ReadFile(const char *path) {
+    string content;
+    int fd = open(path, O_RDONLY);
+    char buf[4096];
+    for(ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;) content.append(buf, n);
+    close(fd);
+    unlink(path);
+    return content;
+}
+
+BOOST_AUTO_TEST_CASE( test_pipeline ) {
+    //same replies and events as the serial path, in the same order
+    OrderFlowConfig config;
+    config.seed = 11;
+    OrderFlowGenerator flow(config);
+    vector<string> messages;
+    OutputBuffer line;
+    Command command;
+    for(int i = 0; i < 50000; ++i) {
+        flow.Next(command);
+        line.Clear();
+        FormatCommand(command, line);
+        messages.emplace_back(line.Data(), line.Size() - 1);
+        if(i % 1000 == 0) messages.push_back("q level bid 0");
+        if(i % 7000 == 0) messages.push_back("not a message");
+    }
+
+    OrderBook serial;
+    EventBuffer events;
+    serial.SetEventBuffer(&events);
+    OutputBuffer replies, eventText;
+    for(const string &message: messages) {
+        serial.ProcessMessage(message, replies);
+        for(size_t i = 0; i < events.Size(); ++i) FormatEvent(events.Data()[i], eventText);
+        events.Clear();
+    }
+
+    char outPath[] = "/tmp/order_book_pipeline_XXXXXX";
+    char eventsPath[] = "/tmp/order_book_pipeline_events_XXXXXX";
+    int outFd = mkstemp(outPath), eventsFd = mkstemp(eventsPath);
+    OrderBook piped;
+    {
+        Pipeline pipeline(piped, false, outFd, eventsFd, false);
+        for(const string &message: messages) pipeline.ProcessMessage(message);
+        BOOST_CHECK(pipeline.Finish());
+    }
+    close(outFd);
+    close(eventsFd);
+    BOOST_CHECK(ReadFile(outPath) == string(replies.Data(), replies.Size()));
+    BOOST_CHECK(ReadFile(eventsPath) == string(eventText.Data(), eventText.Size()));
+    BOOST_CHECK(piped.GetLevel(OrderSide::OrderSide_Buy, 0) == serial.GetLevel(OrderSide::OrderSide_Buy, 0));
+}
+
+BOOST_AUTO_TEST_CASE( test_execute_batch ) {
+    //a batch executes exactly like the same commands one by one
+    OrderFlowConfig config;
+    config.seed = 13;
+    OrderFlowGenerator flow(config);
+    vector<Command> commands(20000);
+    for(size_t i = 0; i < commands.size(); ++i) {
+        flow.Next(commands[i]);
+        if(i % 500 == 0) {
+            commands[i].type = CommandType_QueryLevel;
+            commands[i].side = OrderSide::OrderSide_Sell;
+            commands[i].qty = 0;
+        }
+    }
+
+    OrderBook serial, batched;
+    EventBuffer serialEvents, batchedEvents;
+    serial.SetEventBuffer(&serialEvents);
+    batched.SetEventBuffer(&batchedEvents);
+    OutputBuffer serialReplies, batchedReplies;
+    Reply reply;
+    size_t serialReplied = 0;
+    for(const Command &command: commands) {
+        if(serial.Execute(command, reply)) {
+            FormatReply(reply, serialReplies);
+            ++serialReplied;
+        }
+    }
+    vector<Reply> replies(256);
+    size_t replied = 0;
+    for(size_t i = 0; i < commands.size(); i += replies.size()) {
+        size_t count = min(replies.size(), commands.size() - i);
+        replied += batched.ExecuteBatch(&commands[i], count, replies.data());
+        for(size_t j = 0; j < count; ++j) {
+            if(replies[j].type != ReplyType_None) FormatReply(replies[j], batchedReplies);
+        }
+    }
+    BOOST_CHECK_EQUAL(replied, serialReplied);
+    BOOST_CHECK(string(batchedReplies.Data(), batchedReplies.Size()) == string(serialReplies.Data(), serialReplies.Size()));
+    BOOST_REQUIRE_EQUAL(batchedEvents.Size(), serialEvents.Size());
+    OutputBuffer serialText, batchedText;
+    for(size_t i = 0; i < serialEvents.Size(); ++i) {
+        FormatEvent(serialEvents.Data()[i], serialText);
+        FormatEvent(batchedEvents.Data()[i], batchedText);
+    }
+    BOOST_CHECK(string(batchedText.Data(), batchedText.Size()) == string(serialText.Data(), serialText.Size()));
+}
+
+BOOST_AUTO_TEST_CASE( test_mass_commands ) {
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    OutputBuffer output;
+    for(int i = 0; i < 1000; ++i) {
+        mgr.NewOrder(i + 1, OrderSide::OrderSide_Buy, 10, 10 + (i % 50) * 0.01);
+        mgr.NewOrder(i + 5001, OrderSide::OrderSide_Sell, 10, 11 + (i % 50) * 0.01);
+    }
+    events.Clear();
+
+    //one pass over the range, one aggregated reply, one cancel event per order
+    mgr.ProcessMessage("cancel range buy 10.1 10.19", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "mass cancel, bid, 200, 2000\n");
+    BOOST_CHECK_EQUAL(events.Size(), 200u);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(11)->status, OrderStatus_Canceled);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(10)->status, OrderStatus_New);
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(10.49, 200, 20));
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 30) == make_tuple(10.09, 200, 20));
+
+    //amend down keeps the queue, below the filled qty finishes the order
+    output.Clear();
+    mgr.ProcessMessage("amend range buy 10.49 10.49 4", output);
+    mgr.ProcessMessage("q order 50", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "mass amend, bid, 20, 80\norder, 50, New, 4, 0\n");
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(10.49, 80, 20));
+
+    output.Clear();
+    mgr.ProcessMessage("cancel all sell", output);
+    mgr.ProcessMessage("q level ask 0", output);
+    mgr.ProcessMessage("cancel all", output);
+    mgr.ProcessMessage("cancel range buy 10.2 10.1", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()),
+        "mass cancel, ask, 1000, 10000\nask, 0, 0, 0, 0\nmass cancel, all, 800, 7880\nGot Invalid Message: cancel range buy 10.2 10.1\n");
+    BOOST_CHECK_EQUAL(mgr.GetDepth(OrderSide::OrderSide_Buy).Size(), 0);
+
+    //both travel in binary and in the journal
+    Command command, decoded;
+    BOOST_CHECK_EQUAL(ParseMessage("amend range sell 12.3 12.4 7", command), ParseError_None);
+    uint8_t wire[sizeof(BinaryCommand)];
+    EncodeCommand(command, wire);
+    BOOST_CHECK(DecodeCommand(wire, decoded));
+    BOOST_CHECK_EQUAL(decoded.type, CommandType_MassAmend);
+    BOOST_CHECK_EQUAL(decoded.side, OrderSide_Sell);
+    BOOST_CHECK_EQUAL(decoded.qty, 7);
+    BOOST_CHECK_EQUAL(decoded.tick, command.tick);
+    BOOST_CHECK_EQUAL(decoded.lastTick, command.lastTick);
+    BOOST_CHECK_EQUAL(ParseMessage("cancel all", command), ParseError_None);
+    EncodeCommand(command, wire);
+    BOOST_CHECK(DecodeCommand(wire, decoded) && decoded.side == BothSides && decoded.tick == InvalidTick);
+    output.Clear();
+    FormatCommand(decoded, output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "cancel all\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_timer_wheel ) {
+    //against a sorted list: small steps, jumps over empty wheels and entries on every wheel
+    TimerWheel wheel;
+    vector<pair<Timestamp, int>> expected, fired;
+    uint64_t state = 7;
+    auto next = [&state]() { state = state * 6364136223846793005ULL + 1442695040888963407ULL; return (uint32_t)(state >> 33); };
+    int id = 0;
+    while(wheel.Now() < 4000000000u) {
+        for(int i = 0; i < 3; ++i) {
+            Timestamp delta = 1 + next() % (next() % 4 == 0? 100000000: 1000);
+            if(wheel.Now() > UINT32_MAX - delta) continue;
+            wheel.Schedule(id, wheel.Now() + delta);
+            expected.emplace_back(wheel.Now() + delta, id++);
+        }
+        Timestamp step = next() % 8 == 0? next() % 50000000: next() % 700;
+        if(wheel.Now() > UINT32_MAX - step) break;
+        wheel.Advance(wheel.Now() + step, [&fired](int id, Timestamp time) { fired.emplace_back(time, id); });
+    }
+    wheel.Advance(UINT32_MAX, [&fired](int id, Timestamp time) { fired.emplace_back(time, id); });
+    stable_sort(expected.begin(), expected.end(), [](auto &a, auto &b) { return a.first < b.first; });
+    BOOST_CHECK_EQUAL(wheel.Size(), 0u);
+    BOOST_REQUIRE_EQUAL(fired.size(), expected.size());
+    BOOST_CHECK(fired == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_gtd_expiry ) {
+    Command command;
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 buy 100 12.3 gtd 500", command), ParseError_None);
+    BOOST_CHECK_EQUAL(command.tif, TimeInForce_GTD);
+    BOOST_CHECK_EQUAL(command.time, 500u);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 buy 100 market gtd 500", command), ParseError_UnknownType);
+    BOOST_CHECK_EQUAL(ParseMessage("order 1 buy 100 12.3 gtd", command), ParseError_MissingField);
+    BOOST_CHECK_EQUAL(ParseMessage("time 70000", command), ParseError_None);
+    uint8_t wire[sizeof(BinaryCommand)];
+    Command decoded;
+    EncodeCommand(command, wire);
+    BOOST_CHECK(DecodeCommand(wire, decoded) && decoded.type == CommandType_Clock && decoded.time == 70000);
+
+    char path[] = "/tmp/order_book_gtd_XXXXXX";
+    close(mkstemp(path));
+    OrderBook mgr;
+    EventBuffer events;
+    mgr.SetEventBuffer(&events);
+    mgr.SetSnapshotFile(path);
+    OutputBuffer output;
+    for(const char *message: {"order 1 buy 100 12.3 gtd 1000", "order 2 buy 100 12.3 gtd 500", "order 3 buy 100 12.3",
+                              "order 4 sell 60 12.3 gtd 400", "order 5 sell 10 12.5 gtd 300000", "time 499"}) {
+        mgr.ProcessMessage(message, output);
+    }
+    //order 4 traded away before its time, its entry expires nothing
+    BOOST_CHECK(mgr.GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.3, 240, 3));
+    BOOST_CHECK_EQUAL(mgr.GetOrder(4)->status, OrderStatus_Filled);
+    events.Clear();
+
+    //expiry takes the cancel path, the queue behind keeps its order
+    mgr.ProcessMessage("time 500", output);
+    mgr.ProcessMessage("q order 1", output);
+    BOOST_CHECK_EQUAL(string(output.Data(), output.Size()), "order, 1, PartiallyFilled, 40, 0\n");
+    BOOST_REQUIRE_EQUAL(events.Size(), 1u);
+    BOOST_CHECK_EQUAL(events.Data()[0].orderId, 2);
+    BOOST_CHECK_EQUAL(events.Data()[0].status, OrderStatus_Expired);
+    BOOST_CHECK_EQUAL(mgr.GetOrder(2)->status, OrderStatus_Expired);
+
+    //the clock and the schedule survive a snapshot
+    mgr.ProcessMessage("snapshot", output);
+    OrderBook restored;
+    uint64_t journalRecords;
+    BOOST_REQUIRE(restored.LoadSnapshot(path, journalRecords));
+    BOOST_CHECK_EQUAL(restored.Now(), 500u);
+    for(OrderBook *book: {&mgr, &restored}) {
+        book->NewOrder(6, OrderSide::OrderSide_Buy, 10, 12.0, OrderType_Limit, TimeInForce_GTD, 500);
+        BOOST_CHECK_EQUAL(book->GetOrder(6)->status, OrderStatus_Rejected);
+        book->AdvanceTime(999);
+        BOOST_CHECK(book->GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.3, 140, 2));
+        book->AdvanceTime(300000);
+        BOOST_CHECK(book->GetLevel(OrderSide::OrderSide_Buy, 0) == make_tuple(12.3, 100, 1));
+        BOOST_CHECK(book->GetLevel(OrderSide::OrderSide_Sell, 0) == make_tuple(0.0, 0, 0));
+        BOOST_CHECK_EQUAL(book->GetOrder(5)->status, OrderStatus_Expired);
+    }
+    unlink(path);
+}
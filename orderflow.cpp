@@ -0,0 +1,67 @@
+
+#include <algorithm>
+
+#include "orderflow.h"
+
+using namespace std;
+
+OrderFlowGenerator::OrderFlowGenerator(const OrderFlowConfig &config): config(config), state(config.seed) {
+    if(!PxToTick(config.midPx, midTick)) midTick = TickBand2First;
+    //keep every generated price above 0
+    midTick = max(midTick, (Tick)config.levels + 1);
+}
+
+uint64_t OrderFlowGenerator::Random() {
+    //splitmix64
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+int OrderFlowGenerator::Uniform(int lo, int hi) {
+    return lo + (int)(Random() % (uint64_t)(hi - lo + 1));
+}
+
+void OrderFlowGenerator::NextNew(Command &command, bool aggressive) {
+    command.type = CommandType_NewOrder;
+    command.side = Chance(50)? OrderSide::OrderSide_Buy: OrderSide::OrderSide_Sell;
+    command.orderId = nextId++;
+    command.qty = Uniform(config.minQty, config.maxQty);
+    //passive buys rest below mid, aggressive buys reach above it
+    int offset = Uniform(1, max(config.levels, 1));
+    bool below = (command.side == OrderSide::OrderSide_Buy) != aggressive;
+    command.tick = below? midTick - offset: midTick + offset;
+    live.push_back(command.orderId);
+}
+
+void OrderFlowGenerator::Next(Command &command) {
+    int roll = Uniform(0, 99);
+    if(live.empty() || roll < config.newPct) {
+        NextNew(command, Chance(config.aggressivePct));
+        return;
+    }
+    roll -= config.newPct;
+
+    size_t i = (size_t)(Random() % live.size());
+    command.orderId = live[i];
+    command.side = OrderSide::OrderSide_Buy;
+    command.tick = InvalidTick;
+    if(roll < config.amendPct) {
+        command.type = CommandType_Amend;
+        command.qty = Uniform(config.minQty, config.maxQty);
+    } else if(roll < config.amendPct + config.cancelPct) {
+        command.type = CommandType_Cancel;
+        command.qty = 0;
+        live[i] = live.back();
+        live.pop_back();
+    } else if(Chance(50)) {
+        command.type = CommandType_QueryLevel;
+        command.side = Chance(50)? OrderSide::OrderSide_Buy: OrderSide::OrderSide_Sell;
+        command.orderId = 0;
+        command.qty = Uniform(0, max(config.queryDepth, 1) - 1);
+    } else {
+        command.type = CommandType_QueryOrder;
+        command.qty = 0;
+    }
+}
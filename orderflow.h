@@ -0,0 +1,51 @@
+#ifndef ORDERBOOK_ORDERFLOW_H
+#define ORDERBOOK_ORDERFLOW_H
+
+#include <cstdint>
+#include <vector>
+
+#include "command.h"
+
+//shape of the synthetic flow, the mix is in percent of all messages and should add up to 100
+struct OrderFlowConfig {
+    uint64_t seed = 1;
+    double midPx = 12.00;       //passive orders rest within levels ticks of mid, never at mid
+    int levels = 100;
+    int minQty = 1;
+    int maxQty = 1000;
+    int newPct = 60;
+    int amendPct = 10;
+    int cancelPct = 25;
+    int queryPct = 5;           //half level queries, half order queries
+    int aggressivePct = 10;     //share of new orders priced through mid, up to levels ticks deep
+    int queryDepth = 10;        //level queries ask for levels 0 .. queryDepth - 1
+};
+
+//deterministic order/amend/cancel/query stream, the same config always gives the same messages
+//amends, cancels and order queries target ids that were sent before and have not been canceled by the stream,
+//some of them are filled by then, just like in real flow
+class OrderFlowGenerator {
+
+public:
+    explicit OrderFlowGenerator(const OrderFlowConfig &config);
+
+    void Next(Command &command);
+
+    //a passive or aggressive new order regardless of the mix, used to build up books
+    void NextNew(Command &command, bool aggressive = false);
+
+    int LiveOrders() const { return (int)live.size(); }
+
+private:
+    uint64_t Random();
+    int Uniform(int lo, int hi);    //[lo, hi]
+    bool Chance(int pct) { return Uniform(0, 99) < pct; }
+
+    OrderFlowConfig config;
+    uint64_t state;
+    Tick midTick;
+    int nextId = 1;
+    std::vector<int> live;
+};
+
+#endif //ORDERBOOK_ORDERFLOW_H
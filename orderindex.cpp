@@ -0,0 +1,39 @@
+
+#include "orderindex.h"
+
+using namespace std;
+
+void OrderIndex::Erase(int orderId) {
+    size_t i = Hash(orderId) & mask;
+    while(slots[i].order && slots[i].orderId != orderId) i = (i + 1) & mask;
+    if(!slots[i].order) return;
+
+    //shift back the following entries of the probe chain, so lookups never need tombstones
+    for(size_t j = (i + 1) & mask; slots[j].order; j = (j + 1) & mask) {
+        size_t home = Hash(slots[j].orderId) & mask;
+        if(((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = Slot();
+    --count;
+}
+
+void OrderIndex::Reserve(size_t orders) {
+    size_t size = slots.size();
+    while(orders * 2 > size) size *= 2;
+    if(size != slots.size()) Rehash(size);
+}
+
+void OrderIndex::Rehash(size_t size) {
+    vector<Slot> old(size);
+    old.swap(slots);
+    mask = slots.size() - 1;
+    for(const Slot &slot: old) {
+        if(!slot.order) continue;
+        size_t i = Hash(slot.orderId) & mask;
+        while(slots[i].order) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
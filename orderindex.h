@@ -0,0 +1,75 @@
+#ifndef ORDERBOOK_ORDERINDEX_H
+#define ORDERBOOK_ORDERINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "order.h"
+
+//orderId -> Order open-addressing hash table (linear probing, backward-shift erase, no tombstones)
+//keys are stored next to the pointers, so a lookup does not touch the orders it probes past
+class OrderIndex {
+
+public:
+    OrderIndex(): slots(InitialSlots), mask(InitialSlots - 1) {}
+
+    Order *Find(int orderId) const {
+        for(size_t i = Hash(orderId) & mask; ; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            if(!slot.order) return NULL;
+            if(slot.orderId == orderId) return slot.order;
+        }
+    }
+
+    //starts loading the slot a lookup or insert of orderId begins with
+    void Prefetch(int orderId) const {
+        __builtin_prefetch(&slots[Hash(orderId) & mask]);
+    }
+
+    //pre-condition: orderId must not be in the index
+    void Insert(int orderId, Order *order) {
+        if((count + 1) * 2 > slots.size()) Grow();
+        size_t i = Hash(orderId) & mask;
+        while(slots[i].order) i = (i + 1) & mask;
+        slots[i].orderId = orderId;
+        slots[i].order = order;
+        ++count;
+    }
+
+    void Erase(int orderId);
+
+    //makes room for orders entries in total, so inserting up to that many never rehashes
+    void Reserve(size_t orders);
+
+    size_t Size() const { return count; }
+
+    template<typename F>
+    void ForEach(F f) const {
+        for(const Slot &slot: slots) {
+            if(slot.order) f(slot.order);
+        }
+    }
+
+private:
+    static const size_t InitialSlots = 1024;
+
+    struct Slot {
+        int orderId = 0;
+        Order *order = NULL;
+    };
+
+    static size_t Hash(int orderId) {
+        //fibonacci hashing, sequential ids spread over the table
+        return (size_t)(((uint64_t)(uint32_t)orderId * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    void Grow() { Rehash(slots.size() * 2); }
+    void Rehash(size_t size);
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t count = 0;
+};
+
+#endif //ORDERBOOK_ORDERINDEX_H
@@ -0,0 +1,23 @@
+
+#include <cstdlib>
+#include <new>
+
+#include "orderpool.h"
+
+OrderPool::~OrderPool() {
+    for(void *slab: slabs) {
+        free(slab);
+    }
+}
+
+void OrderPool::AddSlab() {
+    void *block = aligned_alloc(OrderSlabBytes, OrderSlabBytes);
+    if(!block) throw std::bad_alloc();
+    slabs.push_back(block);
+    //handed out lowest address first, so orders entered together share cache lines
+    Order *slab = (Order *)block;
+    for(size_t i = SlabSize; i-- > 0;) {
+        slab[i].next = freeList;
+        freeList = &slab[i];
+    }
+}
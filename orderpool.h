@@ -0,0 +1,48 @@
+#ifndef ORDERBOOK_ORDERPOOL_H
+#define ORDERBOOK_ORDERPOOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include "order.h"
+
+//fixed-size Order slots carved out of preallocated slabs
+//released slots go to a free list (linked through Order::next) and are handed out again before a new slab is taken
+//a slab is laid out the way Order::Info() expects it, hot orders first, their cold parts behind them
+class OrderPool {
+
+public:
+    static const size_t SlabSize = OrderSlabSize;
+
+    OrderPool() {}
+    ~OrderPool();
+
+    OrderPool(const OrderPool &) = delete;
+    OrderPool &operator=(const OrderPool &) = delete;
+
+    Order *Alloc() {
+        if(!freeList) AddSlab();
+        Order *order = freeList;
+        freeList = order->next;
+        ++used;
+        return order;
+    }
+
+    void Free(Order *order) {
+        order->next = freeList;
+        freeList = order;
+        --used;
+    }
+
+    size_t Used() const { return used; }
+    size_t Capacity() const { return slabs.size() * SlabSize; }
+
+private:
+    void AddSlab();
+
+    std::vector<void *> slabs;
+    Order *freeList = NULL;
+    size_t used = 0;
+};
+
+#endif //ORDERBOOK_ORDERPOOL_H
@@ -0,0 +1,20 @@
+
+#include <cerrno>
+#include <unistd.h>
+
+#include "outputbuffer.h"
+
+bool OutputBuffer::FlushTo(int fd) {
+    size_t done = 0;
+    while(done < len) {
+        ssize_t n = write(fd, buf.data() + done, len - done);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            len = 0;
+            return false;
+        }
+        done += n;
+    }
+    len = 0;
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef ORDERBOOK_OUTPUTBUFFER_H
+#define ORDERBOOK_OUTPUTBUFFER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+//reusable reply buffer, formatting appends to it and the owner decides when it is written out
+//numbers are formatted like the default std::ostream << does (prices as %g with 6 digits)
+class OutputBuffer {
+
+public:
+    explicit OutputBuffer(size_t capacity = 1 << 16): buf(capacity) {}
+
+    void Append(std::string_view str) {
+        char *p = Reserve(str.size());
+        memcpy(p, str.data(), str.size());
+        len += str.size();
+    }
+
+    void Append(char c) {
+        *Reserve(1) = c;
+        ++len;
+    }
+
+    void AppendInt(long value) {
+        char *p = Reserve(24);
+        len = std::to_chars(p, p + 24, value).ptr - buf.data();
+    }
+
+    void AppendPx(double px) {
+        char *p = Reserve(32);
+        len = std::to_chars(p, p + 32, px, std::chars_format::general, 6).ptr - buf.data();
+    }
+
+    //room for size bytes written in place, followed by Commit(size)
+    uint8_t *Claim(size_t size) { return (uint8_t *)Reserve(size); }
+    void Commit(size_t size) { len += size; }
+
+    const char *Data() const { return buf.data(); }
+    size_t Size() const { return len; }
+    bool Empty() const { return !len; }
+    void Clear() { len = 0; }
+
+    //writes everything to fd and clears the buffer, false on write error
+    bool FlushTo(int fd);
+
+private:
+    char *Reserve(size_t size) {
+        if(len + size > buf.size()) buf.resize(std::max(buf.size() * 2, len + size));
+        return buf.data() + len;
+    }
+
+    std::vector<char> buf;
+    size_t len = 0;
+};
+
+#endif //ORDERBOOK_OUTPUTBUFFER_H
@@ -0,0 +1,173 @@
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "binaryprotocol.h"
+#include "pipeline.h"
+#include "textprotocol.h"
+
+using namespace std;
+
+static void Pin(thread &t, int core) {
+    int cores = (int)thread::hardware_concurrency();
+    if(cores < 2) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % cores, &set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+}
+
+Pipeline::Pipeline(OrderBook &book, bool binary, int outFd, int eventsFd, bool pinCores, bool busyPoll):
+    book(book), binary(binary), outFd(outFd), eventsFd(eventsFd), busyPoll(busyPoll),
+    messages(QueueSize), results(QueueSize), invalids(QueueSize), texts(QueueSize), parserWait(busyPoll) {
+    book.SetEventBuffer(eventsFd >= 0? &events: NULL);
+    matcher = thread(RunMatcher, this);
+    formatter = thread(RunFormatter, this);
+    if(pinCores) {
+        Pin(matcher, 1);
+        Pin(formatter, 2);
+    }
+}
+
+Pipeline::~Pipeline() {
+    Finish();
+}
+
+bool Pipeline::Finish() {
+    if(matcher.joinable()) {
+        parsed.store(true, memory_order_release);
+        matcher.join();
+        formatter.join();
+        book.SetEventBuffer(NULL);
+    }
+    return !writeFailed.load(memory_order_acquire);
+}
+
+void Pipeline::ProcessMessage(string_view message) {
+    Message next;
+    next.invalid = ParseMessage(message, next.command) != ParseError_None;
+    if(next.invalid) {
+        string text(message);
+        while(!invalids.TryPush(text)) parserWait.Idle();
+        parserWait.Reset();
+    }
+    Submit(next);
+}
+
+void Pipeline::ProcessRecord(const uint8_t *record) {
+    Message next;
+    next.invalid = !DecodeCommand(record, next.command);
+    Submit(next);
+}
+
+void Pipeline::Submit(const Message &message) {
+    while(!messages.TryPush(message)) parserWait.Idle();
+    parserWait.Reset();
+}
+
+void Pipeline::Publish(const Result &result) {
+    //only the formatter holds the matcher up, and it never waits for the matcher while it has work
+    while(!results.TryPush(result)) CpuRelax();
+}
+
+void Pipeline::RunMatcher(Pipeline *pipeline) {
+    OrderBook &book = pipeline->book;
+    WaitStrategy wait(pipeline->busyPoll);
+    OutputBuffer text;
+    Result result;
+    for(;;) {
+        Message *message = pipeline->messages.Front();
+        if(!message) {
+            //the flag is set after the last push, so an empty queue after it is really the end
+            if(pipeline->parsed.load(memory_order_acquire) && pipeline->messages.Empty()) break;
+            wait.Idle();
+            continue;
+        }
+        wait.Reset();
+
+        const Command &command = message->command;
+        if(message->invalid) {
+            if(pipeline->binary) {
+                result.kind = Result::Kind_Reply;
+                result.reply.type = ReplyType_Invalid;
+                result.reply.id = command.orderId;
+            } else {
+                result.kind = Result::Kind_Invalid;
+            }
+            pipeline->Publish(result);
+        } else if(command.type == CommandType_QueryStats) {
+            //formatted here, the counters belong to this thread
+            text.Clear();
+            book.AppendStats(text);
+            while(!pipeline->texts.TryPush(string(text.Data(), text.Size()))) CpuRelax();
+            result.kind = Result::Kind_Text;
+            pipeline->Publish(result);
+        } else if(command.type == CommandType_Snapshot) {
+            book.SaveSnapshot();
+        } else if(book.Execute(command, result.reply)) {
+            result.kind = Result::Kind_Reply;
+            pipeline->Publish(result);
+        }
+        pipeline->messages.Pop();
+
+        EventBuffer &events = pipeline->events;
+        if(!events.Empty()) {
+            result.kind = Result::Kind_Event;
+            for(size_t i = 0; i < events.Size(); ++i) {
+                result.event = events.Data()[i];
+                pipeline->Publish(result);
+            }
+            events.Clear();
+        }
+    }
+    pipeline->matched.store(true, memory_order_release);
+}
+
+void Pipeline::RunFormatter(Pipeline *pipeline) {
+    WaitStrategy wait(pipeline->busyPoll);
+    OutputBuffer output, eventOutput;
+    bool ok = true;
+    for(;;) {
+        Result *result = pipeline->results.Front();
+        if(!result) {
+            //out of work: whatever is formatted goes out now, a busy matcher keeps the writes large
+            if(!output.Empty()) ok = output.FlushTo(pipeline->outFd) && ok;
+            if(!eventOutput.Empty()) ok = eventOutput.FlushTo(pipeline->eventsFd) && ok;
+            if(pipeline->matched.load(memory_order_acquire) && pipeline->results.Empty()) break;
+            wait.Idle();
+            continue;
+        }
+        wait.Reset();
+
+        switch(result->kind) {
+            case Result::Kind_Reply:
+                if(pipeline->binary) {
+                    EncodeReply(result->reply, output.Claim(sizeof(BinaryReply)));
+                    output.Commit(sizeof(BinaryReply));
+                } else {
+                    FormatReply(result->reply, output);
+                }
+                break;
+            case Result::Kind_Event:
+                if(pipeline->binary) {
+                    EncodeEvent(result->event, eventOutput.Claim(sizeof(BinaryEvent)));
+                    eventOutput.Commit(sizeof(BinaryEvent));
+                } else {
+                    FormatEvent(result->event, eventOutput);
+                }
+                break;
+            case Result::Kind_Invalid:
+                FormatInvalid(*pipeline->invalids.Front(), output);
+                pipeline->invalids.Pop();
+                break;
+            case Result::Kind_Text:
+                output.Append(*pipeline->texts.Front());
+                pipeline->texts.Pop();
+                break;
+        }
+        pipeline->results.Pop();
+        if(output.Size() >= (1 << 20)) ok = output.FlushTo(pipeline->outFd) && ok;
+        if(eventOutput.Size() >= (1 << 20)) ok = eventOutput.FlushTo(pipeline->eventsFd) && ok;
+    }
+    if(!ok) pipeline->writeFailed.store(true, memory_order_release);
+}
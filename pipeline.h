@@ -0,0 +1,87 @@
+#ifndef ORDERBOOK_PIPELINE_H
+#define ORDERBOOK_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "orderbook.h"
+#include "spscqueue.h"
+
+//one book, three stages on three cores: the calling thread parses, a matching thread runs the book,
+//a formatting thread turns replies and events into text or binary records and writes them out
+//stages are connected by SpscQueues of decoded commands and results, every stage works in input order,
+//so the output is byte for byte what the serial driver writes
+//the formatting thread writes whenever it runs out of work, so a burst goes out in one write
+class Pipeline {
+
+public:
+    static const size_t QueueSize = 1 << 14;
+
+    //replies go to outFd, events to eventsFd (-1 = none), both in the protocol of the input
+    //pinCores: matching thread on core 1, formatting thread on core 2, core 0 is left to the parser
+    Pipeline(OrderBook &book, bool binary, int outFd, int eventsFd, bool pinCores = true, bool busyPoll = false);
+    ~Pipeline();
+
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    //parser stage, the calling thread: one text line or one binary record
+    void ProcessMessage(std::string_view message);
+    void ProcessRecord(const uint8_t *record);
+
+    //drains both stages and stops their threads, false if a write failed
+    //the book belongs to the calling thread again afterwards
+    bool Finish();
+
+private:
+    //parser -> matcher
+    struct Message {
+        bool invalid;           //text: the message is in invalids, binary: only command.orderId is valid
+        Command command;
+    };
+
+    //matcher -> formatter
+    struct Result {
+        enum Kind : uint8_t {
+            Kind_Reply,
+            Kind_Event,
+            Kind_Invalid,       //text only, the message is in invalids
+            Kind_Text,          //preformatted, in texts
+        };
+        Kind kind;
+        union {
+            Reply reply;
+            Event event;
+        };
+    };
+
+    static void RunMatcher(Pipeline *pipeline);
+    static void RunFormatter(Pipeline *pipeline);
+
+    void Submit(const Message &message);
+    void Publish(const Result &result);
+
+    OrderBook &book;
+    bool binary;
+    int outFd;
+    int eventsFd;
+    bool busyPoll;
+
+    SpscQueue<Message> messages;
+    SpscQueue<Result> results;
+    SpscQueue<std::string> invalids;    //parser -> formatter, the rare text of invalid messages
+    SpscQueue<std::string> texts;       //matcher -> formatter
+    EventBuffer events;                 //matcher only
+
+    WaitStrategy parserWait;
+    std::atomic<bool> parsed{false};    //no more messages
+    std::atomic<bool> matched{false};   //no more results
+    std::atomic<bool> writeFailed{false};
+    std::thread matcher;
+    std::thread formatter;
+};
+
+#endif //ORDERBOOK_PIPELINE_H
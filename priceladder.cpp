@@ -0,0 +1,168 @@
+
+#include <algorithm>
+
+#include "priceladder.h"
+
+using namespace std;
+
+static const long InitialLevels = 4096;
+
+void QueueGaps::Fold() {
+    size_t size = tree.size();
+    if(size < (size_t)nextSeq + 1) {
+        //a new node starts with what its children already count, the seqs it adds were not removed yet
+        tree.resize(nextSeq + 1);
+        for(size_t i = max(size, (size_t)1); i < tree.size(); ++i) {
+            size_t low = i & -i;
+            for(size_t child = i - 1; child > i - low; child -= child & -child) tree[i] += tree[child];
+        }
+    }
+    for(unsigned seq: pending) {
+        for(size_t i = seq + 1; i < tree.size(); i += i & -i) ++tree[i];
+    }
+    pending.clear();
+}
+
+int QueueGaps::RemovedBefore(unsigned seq) const {
+    int removed = 0;
+    for(size_t i = seq; i > 0; i -= i & -i) removed += tree[i];
+    return removed;
+}
+
+void QueueGaps::Reset() {
+    nextSeq = 0;
+    renumber = false;
+    pending.clear();
+    tree.clear();
+}
+
+int PriceLevel::GapPosition(const Order *order, int &renumbered) {
+    if(count <= QueueGaps::ShortLevel) {
+        int pos = 0;
+        for(const Order *it = order->prev; it; it = it->prev) ++pos;
+        return pos;
+    }
+    //the tree would span more than four times the orders on the level (or nextSeq wrapped), start over with contiguous seqs
+    if(gaps->renumber || gaps->nextSeq > 4 * (unsigned)count + 64 || head->Info().seq >= gaps->nextSeq) {
+        gaps->Reset();
+        for(Order *it = head; it; it = it->next) it->Info().seq = gaps->nextSeq++;
+        renumbered = count;
+        return (int)order->Info().seq;
+    }
+    gaps->Fold();
+    unsigned seq = order->Info().seq, headSeq = head->Info().seq;
+    return (int)(seq - headSeq) - (gaps->RemovedBefore(seq) - gaps->RemovedBefore(headSeq));
+}
+
+template<OrderSide Side>
+Tick PriceLadder<Side>::NextTick(Tick tick) const {
+    long idx = (long)tick - baseTick;
+    long size = (long)levels.size();
+    if constexpr(Side == OrderSide::OrderSide_Buy) {
+        for(idx = min(idx - 1, size - 1); idx >= 0; --idx) {
+            if(!levels[idx].Empty()) return (Tick)(baseTick + idx);
+        }
+    } else {
+        for(idx = max(idx + 1, 0L); idx < size; ++idx) {
+            if(!levels[idx].Empty()) return (Tick)(baseTick + idx);
+        }
+    }
+    return InvalidTick;
+}
+
+template<OrderSide Side>
+bool PriceLadder<Side>::CanHold(Tick tick) const {
+    if(!levelCount) return true;
+    long lo = min((long)baseTick, (long)tick);
+    long hi = max((long)baseTick + (long)levels.size() - 1, (long)tick);
+    return hi - lo + 1 <= MaxLevels;
+}
+
+template<OrderSide Side>
+void PriceLadder<Side>::Push(Order *order, Tick tick) {
+    //pre-condition: CanHold(tick)
+    Reserve(tick);
+    auto &level = levels[(long)tick - baseTick];
+    if(level.Empty()) {
+        ++levelCount;
+        if(bestTick == InvalidTick || Better(tick, bestTick))
+            bestTick = tick;
+    }
+    level.PushBack(order);
+}
+
+template<OrderSide Side>
+void PriceLadder<Side>::MoveToBack(Order *order, Tick tick) {
+    //pre-condition: order must be on this px
+    auto &level = levels[(long)tick - baseTick];
+    level.Unlink(order);
+    level.PushBack(order);
+}
+
+template<OrderSide Side>
+void PriceLadder<Side>::Remove(Order *order, Tick tick) {
+    //pre-condition: order must be on this px
+    auto &level = levels[(long)tick - baseTick];
+    level.Unlink(order);
+    if(level.Empty())
+        OnEmptied(tick);
+}
+
+template<OrderSide Side>
+Order *PriceLadder<Side>::PopFront(Tick tick) {
+    PriceLevel *level = Find(tick);
+    if(!level) return NULL;
+    Order *order = level->head;
+    level->Unlink(order);
+    if(level->Empty())
+        OnEmptied(tick);
+    return order;
+}
+
+template<OrderSide Side>
+Order *PriceLadder<Side>::TakeAll(Tick tick) {
+    PriceLevel *level = Find(tick);
+    if(!level) return NULL;
+    Order *first = level->Clear();
+    OnEmptied(tick);
+    return first;
+}
+
+template<OrderSide Side>
+void PriceLadder<Side>::OnEmptied(Tick tick) {
+    --levelCount;
+    if(tick == bestTick)
+        bestTick = levelCount? NextTick(tick): InvalidTick;
+}
+
+template<OrderSide Side>
+void PriceLadder<Side>::Reserve(Tick tick) {
+    long idx = (long)tick - baseTick;
+    if(idx >= 0 && idx < (long)levels.size()) return;
+
+    if(!levelCount) {
+        //nothing rests on this side, just move the reference price
+        if(levels.empty()) levels.resize(InitialLevels);
+        baseTick = (Tick)((long)tick - (long)levels.size() / 2);
+        return;
+    }
+
+    long lo = min((long)baseTick, (long)tick);
+    long hi = max((long)baseTick + (long)levels.size() - 1, (long)tick);
+    long span = hi - lo + 1;
+    long size = (long)levels.size();
+    while(size < span + span / 2 && size < MaxLevels) size *= 2;
+    size = min(size, (long)MaxLevels);
+    long newBase = lo - (size - span) / 2;
+
+    std::vector<PriceLevel> grown(size);
+    for(long i = 0; i < (long)levels.size(); ++i) {
+        if(!levels[i].Empty())
+            grown[baseTick + i - newBase] = std::move(levels[i]);
+    }
+    levels.swap(grown);
+    baseTick = (Tick)newBase;
+}
+
+template class PriceLadder<OrderSide_Buy>;
+template class PriceLadder<OrderSide_Sell>;
@@ -0,0 +1,167 @@
+#ifndef ORDERBOOK_PRICELADDER_H
+#define ORDERBOOK_PRICELADDER_H
+
+#include <memory>
+#include <vector>
+
+#include "order.h"
+
+//sequence numbers that left a level from behind its head, so queue positions stay O(log n) after mid-queue cancels
+//a Fenwick tree over seq counts the removed ones ahead of an order, unlinking only queues the seq and queries fold it in
+//the seqs are renumbered once they span too much more than the level holds, the cost is paid for by the pushes since
+//short levels are walked instead, a cancel there only marks the seqs for renumbering should the level grow
+struct QueueGaps {
+    static const int ShortLevel = 32;   //orders up to which walking the queue beats the tree
+
+    unsigned nextSeq = 0;               //seq of the next order pushed, a removed tail's seq must not be handed out again
+    bool renumber = false;              //the removals are not all in pending, the next query on a long level renumbers
+    std::vector<unsigned> pending;      //removed since the last query
+    std::vector<int> tree;              //1-based Fenwick tree, tree[i] covers seqs [i - lowbit(i), i)
+
+    //count: orders on the level before the removal
+    void Remove(const Order *order, int count) {
+        if(renumber) return;
+        //with no queries the list would grow with every cancel
+        if(count <= ShortLevel || pending.size() > (size_t)count + 64) {
+            renumber = true;
+            pending.clear();
+            return;
+        }
+        pending.push_back(order->Info().seq);
+    }
+
+    //applies the pending removals
+    void Fold();
+    //removed seqs below seq, pre-condition: Fold()
+    int RemovedBefore(unsigned seq) const;
+    void Reset();
+};
+
+//FIFO of the orders resting on one price, linked through Order::prev/next
+//aggregates are maintained on every change so the level never has to be walked to be summarized
+struct PriceLevel {
+    Order *head = NULL;
+    Order *tail = NULL;
+    int qty = 0;        //total leaves qty
+    int count = 0;      //number of orders
+    std::unique_ptr<QueueGaps> gaps;    //allocated on the first unlink from the middle of the queue, kept until Clear()
+
+    bool Empty() const { return !head; }
+
+    void PushBack(Order *order) {
+        order->prev = tail;
+        order->next = NULL;
+        order->Info().seq = gaps? gaps->nextSeq++: tail? tail->Info().seq + 1: 0;
+        if(tail) tail->next = order; else head = order;
+        tail = order;
+        qty += order->leavesQty;
+        ++count;
+    }
+
+    void Unlink(Order *order) {
+        //pre-condition: order must be on this level
+        //leaving from the head or the tail keeps the seqs contiguous until the first gap
+        if(order->prev && (gaps || order->next)) {
+            if(!gaps) {
+                gaps.reset(new QueueGaps());
+                gaps->nextSeq = tail->Info().seq + 1;
+            }
+            gaps->Remove(order, count);
+        }
+        if(order->prev) order->prev->next = order->next; else head = order->next;
+        if(order->next) order->next->prev = order->prev; else tail = order->prev;
+        order->prev = order->next = NULL;
+        qty -= order->leavesQty;
+        if(!--count && gaps) gaps->Reset();
+    }
+
+    //takes every order off the level at once, returns the old head, the chain stays linked through next
+    Order *Clear() {
+        Order *first = head;
+        *this = PriceLevel();
+        return first;
+    }
+
+    //number of orders ahead of this one, renumbered = orders the level had to renumber for it
+    //sequence numbers are contiguous unless something left from the middle of the queue
+    int Position(const Order *order, int &renumbered) {
+        renumbered = 0;
+        if(!gaps) return (int)(order->Info().seq - head->Info().seq);
+        return GapPosition(order, renumbered);
+    }
+
+private:
+    int GapPosition(const Order *order, int &renumbered);
+};
+
+//one side of the book: price levels in a contiguous array indexed by tick offset from baseTick
+//the best price is kept in a cursor, so top of book is O(1) and walking the book is a linear scan
+//over adjacent memory instead of a tree walk
+//the array is recentered/grown when a price falls outside of it (moving reference price)
+//one instance per side, the price ordering is a compile time constant, so nothing on a ladder branches on the side
+template<OrderSide Side>
+class PriceLadder {
+
+public:
+    //upper bound on the width of the ladder, prices further away from the rest of the side are rejected
+    static const int MaxLevels = 1 << 22;
+
+    bool Empty() const { return !levelCount; }
+    Tick BestTick() const { return bestTick; }
+
+    //true if a is a better price than b on this side
+    bool Better(Tick a, Tick b) const {
+        if constexpr(Side == OrderSide_Buy) return a > b; else return a < b;
+    }
+
+    //true if an order at aggressorTick on the opposite side trades with the level at tick
+    bool Crosses(Tick tick, Tick aggressorTick) const {
+        if constexpr(Side == OrderSide_Buy) return tick >= aggressorTick; else return tick <= aggressorTick;
+    }
+
+    //NULL if there is no order on this price
+    PriceLevel *Find(Tick tick) {
+        long idx = (long)tick - baseTick;
+        if(idx < 0 || idx >= (long)levels.size() || levels[idx].Empty()) return NULL;
+        return &levels[idx];
+    }
+
+    //starts loading the level at tick, if the ladder already spans it
+    void Prefetch(Tick tick) const {
+        long idx = (long)tick - baseTick;
+        if(idx >= 0 && idx < (long)levels.size()) __builtin_prefetch(&levels[idx]);
+    }
+
+    //next non-empty price behind tick (worse price), InvalidTick if none
+    Tick NextTick(Tick tick) const;
+
+    //false if the price can't be placed on the ladder
+    bool CanHold(Tick tick) const;
+
+    void Push(Order *order, Tick tick);
+    void MoveToBack(Order *order, Tick tick);
+    void Remove(Order *order, Tick tick);
+
+    //unlinks and returns the first order of the level, NULL if the level is empty
+    Order *PopFront(Tick tick);
+    //empties the whole level in one step, returns its orders as a next-linked chain
+    Order *TakeAll(Tick tick);
+
+private:
+    void Reserve(Tick tick);
+    void OnEmptied(Tick tick);
+
+    Tick baseTick = 0;                 //tick of levels[0]
+    Tick bestTick = InvalidTick;       //best non-empty price, InvalidTick if side is empty
+    int levelCount = 0;                //number of non-empty levels
+    std::vector<PriceLevel> levels;
+};
+
+//both are instantiated once, in priceladder.cpp
+extern template class PriceLadder<OrderSide_Buy>;
+extern template class PriceLadder<OrderSide_Sell>;
+
+typedef PriceLadder<OrderSide_Buy> BidLadder;
+typedef PriceLadder<OrderSide_Sell> AskLadder;
+
+#endif //ORDERBOOK_PRICELADDER_H
@@ -0,0 +1,167 @@
+
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shmtransport.h"
+
+using namespace std;
+
+static const char Magic[8] = {'O', 'B', 'S', 'H', 'M', '2', 0, 0};
+
+//segment layout: Header, then the slots of commands, replies and events, capacity records each
+struct ShmTransport::Header {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t capacity;
+    alignas(64) std::atomic<uint32_t> shutdown;
+    std::atomic<uint32_t> eventsSubscribed;
+    ShmRingControl rings[3];
+};
+
+size_t ShmRing::PushSome(const uint8_t *records, size_t count) {
+    uint64_t t = control->tail.load(memory_order_relaxed);
+    if(t - cachedHead + count > mask + 1) cachedHead = control->head.load(memory_order_acquire);
+    count = min(count, (size_t)(mask + 1 - (t - cachedHead)));
+    if(!count) return 0;
+    size_t first = (size_t)(t & mask);
+    size_t tillWrap = min(count, mask + 1 - first);
+    memcpy(slots + first * RecordSize, records, tillWrap * RecordSize);
+    memcpy(slots, records + tillWrap * RecordSize, (count - tillWrap) * RecordSize);
+    control->tail.store(t + count, memory_order_release);
+    return count;
+}
+
+void ShmRing::PushAll(const uint8_t *records, size_t count, WaitStrategy &wait) {
+    while(count) {
+        size_t pushed = PushSome(records, count);
+        if(!pushed) {
+            wait.Idle();
+            continue;
+        }
+        wait.Reset();
+        records += pushed * RecordSize;
+        count -= pushed;
+    }
+}
+
+bool ShmTransport::Create(const char *name, size_t capacity) {
+    Close();
+    size_t size = 2;
+    while(size < capacity) size *= 2;
+    capacity = size;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0) return false;
+    size_t total = sizeof(Header) + 3 * capacity * ShmRing::RecordSize;
+    if(ftruncate(fd, (off_t)total) < 0 || !Map(fd, total)) {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    close(fd);
+
+    new(header) Header();
+    header->recordSize = (uint32_t)ShmRing::RecordSize;
+    header->capacity = (uint32_t)capacity;
+    header->shutdown.store(0, memory_order_relaxed);
+    header->eventsSubscribed.store(0, memory_order_relaxed);
+    for(ShmRingControl &ring: header->rings) {
+        ring.head.store(0, memory_order_relaxed);
+        ring.tail.store(0, memory_order_relaxed);
+    }
+    //the magic goes last, a gateway that finds it finds a ready segment
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, Magic, sizeof(Magic));
+    Attach();
+    return true;
+}
+
+bool ShmTransport::Open(const char *name) {
+    Close();
+    int fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header) || !Map(fd, (size_t)st.st_size)) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+    atomic_thread_fence(memory_order_acquire);
+    if(memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->recordSize != ShmRing::RecordSize
+       || mappedSize != sizeof(Header) + 3 * (size_t)header->capacity * ShmRing::RecordSize) {
+        Close();
+        return false;
+    }
+    Attach();
+    return true;
+}
+
+bool ShmTransport::Map(int fd, size_t size) {
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED) return false;
+    header = (Header *)mapping;
+    mappedSize = size;
+    return true;
+}
+
+void ShmTransport::Attach() {
+    size_t capacity = header->capacity;
+    uint8_t *slots = (uint8_t *)(header + 1);
+    commands = ShmRing(&header->rings[0], slots, capacity);
+    replies = ShmRing(&header->rings[1], slots + capacity * ShmRing::RecordSize, capacity);
+    events = ShmRing(&header->rings[2], slots + 2 * capacity * ShmRing::RecordSize, capacity);
+}
+
+void ShmTransport::Close() {
+    if(header) munmap(header, mappedSize);
+    header = NULL;
+    mappedSize = 0;
+    commands = replies = events = ShmRing();
+}
+
+void ShmTransport::Unlink(const char *name) {
+    shm_unlink(name);
+}
+
+void ShmTransport::Shutdown() {
+    if(header) header->shutdown.store(1, memory_order_release);
+}
+
+bool ShmTransport::IsShutdown() const {
+    return !header || header->shutdown.load(memory_order_acquire);
+}
+
+void ShmTransport::SubscribeEvents() {
+    if(header) header->eventsSubscribed.store(1, memory_order_release);
+}
+
+bool ShmTransport::EventsSubscribed() const {
+    return header && header->eventsSubscribed.load(memory_order_acquire);
+}
+
+bool ShmClient::Drain() {
+    bool drained = false;
+    size_t count;
+    while(const uint8_t *records = transport.Replies().Peek(count)) {
+        for(size_t i = 0; i < count; ++i) {
+            replies.emplace_back();
+            DecodeReply(records + i * ShmRing::RecordSize, replies.back());
+        }
+        transport.Replies().Consume(count);
+        drained = true;
+    }
+    while(const uint8_t *records = transport.Events().Peek(count)) {
+        for(size_t i = 0; i < count; ++i) {
+            events.emplace_back();
+            DecodeEvent(records + i * ShmRing::RecordSize, events.back());
+        }
+        transport.Events().Consume(count);
+        drained = true;
+    }
+    return drained;
+}
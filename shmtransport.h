@@ -0,0 +1,200 @@
+#ifndef ORDERBOOK_SHMTRANSPORT_H
+#define ORDERBOOK_SHMTRANSPORT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+
+#include "binaryprotocol.h"
+#include "spscqueue.h"
+
+//order_book <-> co-located gateway over a named POSIX shared-memory segment, no syscalls per message
+//the segment holds three single-producer/single-consumer rings of binary protocol records (all 24 bytes):
+//commands (gateway -> book), replies and events (book -> gateway)
+
+//indexes of one ring, on their own cache lines, inside the segment
+struct ShmRingControl {
+    alignas(64) std::atomic<uint64_t> head;     //written by the consumer
+    alignas(64) std::atomic<uint64_t> tail;     //written by the producer
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indexes are shared between processes");
+
+//process-local handle of one ring, each side keeps a private copy of the other side's index
+//like SpscQueue, only that the records are raw wire bytes in the shared segment
+class ShmRing {
+
+public:
+    static const size_t RecordSize = sizeof(BinaryCommand);
+
+    ShmRing() {}
+    ShmRing(ShmRingControl *control, uint8_t *slots, size_t capacity):
+        control(control), slots(slots), mask(capacity - 1) {}
+
+    //producer side: room for one record, written in place and published with Commit(), NULL if the ring is full
+    uint8_t *Claim() {
+        uint64_t t = control->tail.load(std::memory_order_relaxed);
+        if(t - cachedHead > mask) {
+            cachedHead = control->head.load(std::memory_order_acquire);
+            if(t - cachedHead > mask) return NULL;
+        }
+        return slots + (t & mask) * RecordSize;
+    }
+
+    void Commit() {
+        control->tail.store(control->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //producer side: copies as many of count records as fit, publishes them at once, returns how many
+    size_t PushSome(const uint8_t *records, size_t count);
+    //producer side: waits while the ring is full until all count records are in, like a blocking write to a pipe
+    void PushAll(const uint8_t *records, size_t count, WaitStrategy &wait);
+
+    //consumer side: the oldest records that are contiguous in the ring, count = 0 (and NULL) if it is empty
+    const uint8_t *Peek(size_t &count) {
+        uint64_t h = control->head.load(std::memory_order_relaxed);
+        if(h == cachedTail) {
+            cachedTail = control->tail.load(std::memory_order_acquire);
+            if(h == cachedTail) {
+                count = 0;
+                return NULL;
+            }
+        }
+        size_t first = (size_t)(h & mask);
+        count = std::min((size_t)(cachedTail - h), mask + 1 - first);
+        return slots + first * RecordSize;
+    }
+
+    //consumer side, pre-condition: count <= what Peek returned
+    void Consume(size_t count) {
+        control->head.store(control->head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+private:
+    ShmRingControl *control = NULL;
+    uint8_t *slots = NULL;
+    size_t mask = 0;
+    uint64_t cachedHead = 0;    //producer's view of head
+    uint64_t cachedTail = 0;    //consumer's view of tail
+};
+
+//the mapped segment, created by order_book (Create) and attached to by the gateway (Open)
+class ShmTransport {
+
+public:
+    static const size_t DefaultCapacity = 1 << 16;      //records per ring
+
+    ShmTransport() {}
+    ~ShmTransport() { Close(); }
+    ShmTransport(const ShmTransport &) = delete;
+    ShmTransport &operator=(const ShmTransport &) = delete;
+
+    //name is a POSIX shm name ("/orderbook"), an existing segment of that name is replaced
+    bool Create(const char *name, size_t capacity = DefaultCapacity);
+    bool Open(const char *name);
+    void Close();
+    //removes the name, mappings stay valid until they are closed
+    static void Unlink(const char *name);
+
+    ShmRing &Commands() { return commands; }
+    ShmRing &Replies() { return replies; }
+    ShmRing &Events() { return events; }
+
+    //the gateway is done sending, the book drains what is left and stops
+    void Shutdown();
+    bool IsShutdown() const;
+
+    //the book only produces events once the gateway subscribed, a ring nobody reads would fill up and stall the book
+    void SubscribeEvents();
+    bool EventsSubscribed() const;
+
+private:
+    struct Header;
+
+    bool Map(int fd, size_t size);
+    void Attach();
+
+    Header *header = NULL;
+    size_t mappedSize = 0;
+    ShmRing commands;
+    ShmRing replies;
+    ShmRing events;
+};
+
+//reference gateway side: encodes commands straight into the command ring, decodes replies and events
+class ShmClient {
+
+public:
+    explicit ShmClient(bool busyPoll = false): wait(busyPoll) {}
+
+    //events: subscribe to execution reports, which then have to be polled (or Send buffers them)
+    bool Connect(const char *name, bool events = false) {
+        if(!transport.Open(name)) return false;
+        if(events) transport.SubscribeEvents();
+        return true;
+    }
+
+    //waits while the ring is full, the book drains it as fast as it matches
+    //meanwhile replies and events are moved to client side buffers, the book may be waiting for room in those rings
+    void Send(const Command &command) {
+        uint8_t *slot;
+        while(!(slot = transport.Commands().Claim())) {
+            if(!Drain()) wait.Idle();
+        }
+        wait.Reset();
+        EncodeCommand(command, slot);
+        transport.Commands().Commit();
+    }
+
+    //non-blocking, false if there is nothing to read
+    bool PollReply(Reply &reply) {
+        if(!replies.empty()) {
+            reply = replies.front();
+            replies.pop_front();
+            return true;
+        }
+        size_t count;
+        const uint8_t *record = transport.Replies().Peek(count);
+        if(!count) return false;
+        DecodeReply(record, reply);
+        transport.Replies().Consume(1);
+        return true;
+    }
+
+    bool PollEvent(Event &event) {
+        if(!events.empty()) {
+            event = events.front();
+            events.pop_front();
+            return true;
+        }
+        size_t count;
+        const uint8_t *record = transport.Events().Peek(count);
+        if(!count) return false;
+        DecodeEvent(record, event);
+        transport.Events().Consume(1);
+        return true;
+    }
+
+    //waits for the next reply with the client's wait strategy
+    void WaitReply(Reply &reply) {
+        while(!PollReply(reply)) wait.Idle();
+        wait.Reset();
+    }
+
+    //tells the book no more commands are coming
+    void Close() { transport.Shutdown(); }
+
+private:
+    //moves whatever the book published to replies and events, false if there was nothing
+    bool Drain();
+
+    ShmTransport transport;
+    WaitStrategy wait;
+    std::deque<Reply> replies;      //read off the ring by Send, older than anything still in the ring
+    std::deque<Event> events;
+};
+
+#endif //ORDERBOOK_SHMTRANSPORT_H
@@ -0,0 +1,137 @@
+
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "orderbook.h"
+#include "snapshot.h"
+
+using namespace std;
+
+static const char Magic[8] = {'O', 'B', 'S', 'N', 'A', 'P', '2', 0};
+
+static void AppendOrder(const Order *order, OutputBuffer &output) {
+    SnapshotOrder record;
+    memset(&record, 0, sizeof(record));
+    record.orderId = order->orderId;
+    record.orderQty = order->OrderQty();
+    record.cumQty = order->CumQty();
+    record.tick = order->orderTick;
+    record.side = (uint8_t)order->side;
+    record.status = (uint8_t)order->status;
+    record.orderType = (uint8_t)order->type;
+    record.tif = (uint8_t)order->tif;
+    record.expireTime = order->tif == TimeInForce_GTD? order->Info().expireTime: 0;
+    memcpy(output.Claim(sizeof(record)), &record, sizeof(record));
+    output.Commit(sizeof(record));
+}
+
+bool OrderBook::SaveSnapshot(const char *path) {
+    //everything the snapshot covers has to be in the journal for good before the snapshot can say so
+    if(journal && !journal->Sync()) return false;
+
+    //written next to the target and renamed over it, so the latest complete snapshot is always there
+    string tmp = string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.orderSize = sizeof(SnapshotOrder);
+    header.clock = expiries.Now();
+    header.journalRecords = journal? journal->Records(): 0;
+    header.retiredOrders = retiredCount;
+    header.restingOrders = orders.Size() - retiredCount;
+
+    OutputBuffer output;
+    memcpy(output.Claim(sizeof(header)), &header, sizeof(header));
+    output.Commit(sizeof(header));
+    bool ok = true;
+    for(OrderSide side: {OrderSide::OrderSide_Buy, OrderSide::OrderSide_Sell}) {
+        WithLevels(side, [&](auto &levels) {
+            for(Tick px = levels.BestTick(); px != InvalidTick && ok; px = levels.NextTick(px)) {
+                for(const Order *order = levels.Find(px)->head; order; order = order->next) {
+                    AppendOrder(order, output);
+                }
+                if(output.Size() >= (1 << 20)) ok = output.FlushTo(fd);
+            }
+        });
+    }
+    for(const Order *order = retiredHead; order && ok; order = order->next) {
+        AppendOrder(order, output);
+        if(output.Size() >= (1 << 20)) ok = output.FlushTo(fd);
+    }
+    ok = ok && output.FlushTo(fd) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path) < 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool OrderBook::LoadSnapshot(const char *path, uint64_t &journalRecords) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) return false;
+
+    const SnapshotHeader *header = (const SnapshotHeader *)mapping;
+    const SnapshotOrder *records = (const SnapshotOrder *)(header + 1);
+    size_t count = header->restingOrders + header->retiredOrders;
+    if(memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->orderSize != sizeof(SnapshotOrder)
+       || size != sizeof(SnapshotHeader) + count * sizeof(SnapshotOrder)) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    //the records are used in place, the only per-order work is taking a pool slot and linking it
+    orders.Reserve(orders.Size() + count);
+    expiries.Advance(header->clock, [](int, Timestamp) {});    //nothing is scheduled yet, this only sets the clock
+    Tick lastTick = InvalidTick;
+    OrderSide lastSide = OrderSide::OrderSide_Buy;
+    for(size_t i = 0; i < count; ++i) {
+        const SnapshotOrder &record = records[i];
+        Order *order = pool.Alloc();
+        order->orderId = record.orderId;
+        order->side = (OrderSide)record.side;
+        order->status = (OrderStatus)record.status;
+        order->leavesQty = record.orderQty - record.cumQty;
+        order->orderTick = record.tick;
+        OrderInfo &info = order->Info();
+        info.orderQty = record.orderQty;
+        info.orderPx = record.tick == InvalidTick? 0: TickToPx(record.tick);
+        order->type = record.orderType? (OrderType)record.orderType: OrderType_Limit;
+        order->tif = record.tif? (TimeInForce)record.tif: TimeInForce_Day;
+        info.expireTime = record.expireTime;
+        orders.Insert(order->orderId, order);
+        if(i >= header->restingOrders) {
+            Retire(order);
+            continue;
+        }
+
+        //orders of one level are adjacent, publish each level once it is complete
+        if(lastTick != InvalidTick && (order->orderTick != lastTick || order->side != lastSide)) OnLevelChanged(lastSide, lastTick);
+        WithLevels(order->side, [order](auto &levels) { levels.Push(order, order->orderTick); });
+        if(order->tif == TimeInForce_GTD) expiries.Schedule(order->orderId, record.expireTime);
+        lastTick = order->orderTick;
+        lastSide = order->side;
+    }
+    if(lastTick != InvalidTick) OnLevelChanged(lastSide, lastTick);
+
+    journalRecords = header->journalRecords;
+    munmap(mapping, size);
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef ORDERBOOK_SNAPSHOT_H
+#define ORDERBOOK_SNAPSHOT_H
+
+#include <cstdint>
+
+//flat, position-independent image of one OrderBook, host byte order, written by OrderBook::SaveSnapshot
+//header, then the resting orders side by side, level by level best first, in queue order,
+//then the finished orders the book still retains, oldest first
+//replaying the orders in file order rebuilds the exact queues, so no pointers or positions are stored
+
+struct SnapshotHeader {
+    char magic[8];              //"OBSNAP2"
+    uint32_t orderSize;         //sizeof(SnapshotOrder)
+    uint32_t clock;             //logical time of the book
+    uint64_t journalRecords;    //journal records the snapshot covers, replay continues behind them
+    uint64_t restingOrders;
+    uint64_t retiredOrders;
+    uint64_t reserved2[3];
+};
+
+struct SnapshotOrder {
+    int32_t orderId;
+    int32_t orderQty;
+    int32_t cumQty;
+    int32_t tick;
+    uint8_t side;               //OrderSide
+    uint8_t status;             //OrderStatus
+    uint8_t orderType;          //OrderType, 0 = limit
+    uint8_t tif;                //TimeInForce, 0 = day
+    uint32_t expireTime;        //GTD orders, 0 otherwise
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader is a file format");
+static_assert(sizeof(SnapshotOrder) == 24, "SnapshotOrder is a file format");
+
+#endif //ORDERBOOK_SNAPSHOT_H
@@ -0,0 +1,110 @@
+#ifndef ORDERBOOK_SPSCQUEUE_H
+#define ORDERBOOK_SPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//spin-wait hint for busy-polling loops
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+//what a side does while the queue it waits on is empty or full
+//busy poll never gives the core away (lowest latency, burns a core), adaptive spins, then yields, then sleeps
+class WaitStrategy {
+
+public:
+    explicit WaitStrategy(bool busyPoll = false): busyPoll(busyPoll) {}
+
+    void Idle() {
+        if(busyPoll || ++idle < 256) {
+            CpuRelax();
+        } else if(idle < 1024) {
+            std::this_thread::yield();
+        } else {
+            //a quiet peer costs a wakeup every 50us, the first message after a pause pays for it once
+            std::this_thread::sleep_for(std::chrono::microseconds(idle < 4096? 1: 50));
+        }
+    }
+
+    void Reset() { idle = 0; }
+
+private:
+    bool busyPoll;
+    unsigned idle = 0;
+};
+
+//bounded lock-free single-producer/single-consumer ring
+//each side caches the other side's index, so the shared cache lines are only touched when the cached view runs out
+template<typename T>
+class SpscQueue {
+
+public:
+    //capacity is rounded up to a power of 2
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while(size < capacity) size *= 2;
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    //producer side
+    bool TryPush(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if(t - cachedHead > mask) return false;
+        }
+        items[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer side, NULL if empty
+    T *Front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if(h == cachedTail) return NULL;
+        }
+        return &items[h & mask];
+    }
+
+    //consumer side, pre-condition: Front() != NULL
+    void Pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool TryPop(T &item) {
+        T *front = Front();
+        if(!front) return false;
+        item = *front;
+        Pop();
+        return true;
+    }
+
+    //approximate, only exact when both sides are quiet
+    bool Empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head{0};    //written by consumer
+    size_t cachedTail = 0;                      //consumer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};    //written by producer
+    size_t cachedHead = 0;                      //producer's view of head
+    alignas(64) std::vector<T> items;
+    size_t mask;
+};
+
+#endif //ORDERBOOK_SPSCQUEUE_H
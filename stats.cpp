@@ -0,0 +1,90 @@
+
+#include <chrono>
+
+#include "stats.h"
+
+using namespace std;
+
+static const uint64_t startTsc = ReadTsc();
+static const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+double TscNanos() {
+    uint64_t tsc = ReadTsc();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count();
+    return tsc > startTsc && ns > 0? ns / (double)(tsc - startTsc): 1;
+}
+
+uint64_t Histogram::BucketHigh(int bucket) {
+    if(bucket < (1 << SubBits)) return (uint64_t)bucket;
+    int shift = (bucket >> SubBits) - 1;
+    uint64_t low = (uint64_t)((1 << SubBits) | (bucket & ((1 << SubBits) - 1))) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t Histogram::Percentile(double p) const {
+    if(!total) return 0;
+    uint64_t rank = (uint64_t)(p * (double)total);
+    if(rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < Buckets; ++i) {
+        seen += counts[i];
+        if(seen > rank) return min(BucketHigh(i), max);
+    }
+    return max;
+}
+
+static void AppendPercentiles(const Histogram &histogram, double scale, OutputBuffer &output) {
+    for(double p: {0.50, 0.99, 0.999}) {
+        output.Append(", ");
+        output.AppendInt((long)((double)histogram.Percentile(p) * scale + 0.5));
+    }
+}
+
+static void AppendStages(string_view name, const StageStats &stages, double nanos, OutputBuffer &output) {
+    if(!stages.match.Count()) return;
+    output.Append("stats, ");
+    output.Append(name);
+    output.Append(", ");
+    output.AppendInt((long)stages.match.Count());
+    output.Append(", parse");
+    AppendPercentiles(stages.parse, nanos, output);
+    output.Append(", match");
+    AppendPercentiles(stages.match, nanos, output);
+    output.Append(", output");
+    AppendPercentiles(stages.output, nanos, output);
+    output.Append('\n');
+}
+
+static void AppendDistribution(string_view name, const Histogram &histogram, OutputBuffer &output) {
+    output.Append("stats, ");
+    output.Append(name);
+    output.Append(", ");
+    output.AppendInt((long)histogram.Count());
+    AppendPercentiles(histogram, 1, output);
+    output.Append(", ");
+    output.AppendInt((long)histogram.Max());
+    output.Append('\n');
+}
+
+void FormatStats(const BookStats &stats, OutputBuffer &output) {
+    output.Append("stats, messages, ");
+    output.AppendInt((long)stats.messages);
+    output.Append(", invalid, ");
+    output.AppendInt((long)stats.invalid);
+    output.Append(", rejected, ");
+    output.AppendInt((long)stats.rejected);
+    output.Append(", fills, ");
+    output.AppendInt((long)stats.fills);
+    output.Append('\n');
+
+    double nanos = TscNanos();
+    AppendStages("order", stats.newOrder, nanos, output);
+    AppendStages("amend", stats.amend, nanos, output);
+    AppendStages("cancel", stats.cancel, nanos, output);
+    AppendStages("level", stats.queryLevel, nanos, output);
+    AppendStages("query", stats.queryOrder, nanos, output);
+    AppendStages("mass", stats.mass, nanos, output);
+    AppendStages("time", stats.clock, nanos, output);
+    AppendDistribution("levels per match", stats.levelsPerMatch, output);
+    AppendDistribution("position renumber", stats.positionRenumber, output);
+}
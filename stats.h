@@ -0,0 +1,117 @@
+#ifndef ORDERBOOK_STATS_H
+#define ORDERBOOK_STATS_H
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "command.h"
+#include "outputbuffer.h"
+
+//hot-path instrumentation is compiled in when ORDERBOOK_STATS is defined (cmake -DORDERBOOK_STATS=ON, the default)
+//STATS(...) expands to its argument only then, so the hot path carries no trace of it otherwise
+#ifdef ORDERBOOK_STATS
+#define STATS(...) __VA_ARGS__
+#else
+#define STATS(...)
+#endif
+
+//raw timestamp: TSC cycles on x86, steady_clock ns elsewhere
+inline uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+//ns per ReadTsc() unit, measured against steady_clock since the process started
+double TscNanos();
+
+//log-linear (HDR style) histogram: exact below 16, 16 sub-buckets per power of 2 above, ~6% resolution
+//fixed size, recording a value is a bit scan and an increment
+class Histogram {
+
+public:
+    static const int SubBits = 4;
+    static const int Buckets = (64 - SubBits + 1) << SubBits;
+
+    void Add(uint64_t value) {
+        ++counts[Bucket(value)];
+        ++total;
+        if(value > max) max = value;
+    }
+
+    uint64_t Count() const { return total; }
+    uint64_t Max() const { return max; }
+
+    //upper bound of the bucket holding the p-th sample, 0 <= p <= 1
+    uint64_t Percentile(double p) const;
+
+private:
+    static int Bucket(uint64_t value) {
+        if(value < (1u << SubBits)) return (int)value;
+        int msb = 63 - __builtin_clzll(value);
+        return ((msb - SubBits + 1) << SubBits) | (int)((value >> (msb - SubBits)) & ((1u << SubBits) - 1));
+    }
+
+    static uint64_t BucketHigh(int bucket);
+
+    uint64_t counts[Buckets] = {};
+    uint64_t total = 0;
+    uint64_t max = 0;
+};
+
+//where the time of one message type goes, in ReadTsc() units
+struct StageStats {
+    Histogram parse;    //text protocol only
+    Histogram match;    //book work in Execute
+    Histogram output;   //formatting the reply, text protocol only
+};
+
+struct BookStats {
+    uint64_t messages = 0;      //executed commands
+    uint64_t invalid = 0;       //messages that did not parse
+    uint64_t rejected = 0;      //commands the book refused (duplicate/unknown/finished id, price out of range)
+    uint64_t fills = 0;
+
+    StageStats newOrder;
+    StageStats amend;
+    StageStats cancel;
+    StageStats queryLevel;
+    StageStats queryOrder;
+    StageStats mass;            //mass cancels and amends
+    StageStats clock;           //clock commands, including the expiries they cause
+
+    Histogram levelsPerMatch;   //opposite levels traded against, aggressive orders only
+    Histogram positionRenumber; //orders renumbered to answer a queue position, only when the seqs of a level got too sparse
+
+    StageStats &ForType(CommandType type) {
+        switch(type) {
+            case CommandType_Amend: return amend;
+            case CommandType_Cancel: return cancel;
+            case CommandType_QueryLevel: return queryLevel;
+            case CommandType_QueryOrder: return queryOrder;
+            case CommandType_MassCancel:
+            case CommandType_MassAmend: return mass;
+            case CommandType_Clock: return clock;
+            case CommandType_NewOrder:
+            case CommandType_QueryStats:
+            case CommandType_Snapshot:
+                break;
+        }
+        return newOrder;
+    }
+};
+
+//one line per counter group, latencies as p50, p99, p99.9 in ns
+//stats, messages, 31, invalid, 1, rejected, 0, fills, 4
+//stats, order, 12, parse, 41, 88, 88, match, 160, 1210, 1210, output, 0, 0, 0
+//stats, levels per match, 3, 1, 2, 2, 2                (count, p50, p99, p99.9, max)
+void FormatStats(const BookStats &stats, OutputBuffer &output);
+
+#endif //ORDERBOOK_STATS_H
@@ -0,0 +1,441 @@
+
+#include <charconv>
+
+#include "textprotocol.h"
+
+using namespace std;
+
+//splits on every single space like boost::split did, so doubled spaces give empty (invalid) tokens
+struct Tokenizer {
+    string_view rest;
+    bool done;
+
+    explicit Tokenizer(string_view message): rest(message), done(false) {}
+
+    bool Next(string_view &token) {
+        if(done) return false;
+        size_t pos = rest.find(' ');
+        if(pos == string_view::npos) {
+            token = rest;
+            done = true;
+        } else {
+            token = rest.substr(0, pos);
+            rest.remove_prefix(pos + 1);
+        }
+        return true;
+    }
+};
+
+static ParseError ParseInt(string_view token, int &value) {
+    const char *end = token.data() + token.size();
+    auto res = from_chars(token.data(), end, value);
+    if(res.ec == errc::result_out_of_range) return ParseError_OutOfRange;
+    if(res.ec != errc() || res.ptr != end) return ParseError_BadNumber;
+    return ParseError_None;
+}
+
+static ParseError NextInt(Tokenizer &tokens, int &value) {
+    string_view token;
+    if(!tokens.Next(token)) return ParseError_MissingField;
+    return ParseInt(token, value);
+}
+
+static ParseError NextSide(Tokenizer &tokens, string_view buy, string_view sell, OrderSide &side) {
+    string_view token;
+    if(!tokens.Next(token)) return ParseError_MissingField;
+    if(token == buy) {
+        side = OrderSide::OrderSide_Buy;
+    } else if(token == sell) {
+        side = OrderSide::OrderSide_Sell;
+    } else {
+        return ParseError_BadSide;
+    }
+    return ParseError_None;
+}
+
+static ParseError NextTime(Tokenizer &tokens, Timestamp &time) {
+    string_view token;
+    if(!tokens.Next(token)) return ParseError_MissingField;
+    const char *end = token.data() + token.size();
+    auto res = from_chars(token.data(), end, time);
+    if(res.ec == errc::result_out_of_range) return ParseError_OutOfRange;
+    if(res.ec != errc() || res.ptr != end) return ParseError_BadNumber;
+    return ParseError_None;
+}
+
+static ParseError NextPrice(Tokenizer &tokens, Tick &tick) {
+    string_view token;
+    int64_t mills;
+    if(!tokens.Next(token)) return ParseError_MissingField;
+    if(!ParseMills(token, mills)) return ParseError_BadPrice;
+    if(mills <= 0) return ParseError_OutOfRange;
+    if(!MillsToTick(mills, tick)) return ParseError_BadPrice;
+    return ParseError_None;
+}
+
+//lowest and highest price of a mass command, both inclusive
+static ParseError NextRange(Tokenizer &tokens, Command &command) {
+    ParseError err;
+    if((err = NextPrice(tokens, command.tick))) return err;
+    if((err = NextPrice(tokens, command.lastTick))) return err;
+    if(command.lastTick < command.tick) return ParseError_OutOfRange;
+    return ParseError_None;
+}
+
+bool ParseMills(string_view token, int64_t &mills) {
+    size_t dot = token.find('.');
+    string_view intPart = token.substr(0, dot);
+    string_view fracPart = dot == string_view::npos? string_view(): token.substr(dot + 1);
+    if(intPart.empty() && fracPart.empty()) return false;
+
+    int64_t units = 0;
+    if(!intPart.empty()) {
+        const char *end = intPart.data() + intPart.size();
+        auto res = from_chars(intPart.data(), end, units);
+        if(res.ec != errc() || res.ptr != end || intPart[0] == '-') return false;
+        if(units > INT64_MAX / 1000) return false;
+    }
+
+    int64_t frac = 0;
+    for(size_t i = 0; i < fracPart.size(); ++i) {
+        char c = fracPart[i];
+        if(c < '0' || c > '9') return false;
+        if(i < 3) {
+            frac = frac * 10 + (c - '0');
+        } else if(c != '0') {
+            return false;   //finer than any tick
+        }
+    }
+    for(size_t i = fracPart.size(); i < 3; ++i) frac *= 10;
+
+    mills = units * 1000 + frac;
+    return true;
+}
+
+ParseError ParseMessage(string_view message, Command &command) {
+    if(!message.empty() && message.back() == '\r') message.remove_suffix(1);
+    if(message.empty()) return ParseError_Empty;
+
+    Tokenizer tokens(message);
+    string_view type, token;
+    tokens.Next(type);
+    if(type.empty()) return ParseError_UnknownType;
+
+    ParseError err;
+    switch(type[0]) {
+        case 'o': {
+            //order 1001 buy 100 12.30
+            //order 1001 buy 100 12.30 ioc|fok|post
+            //order 1001 buy 100 12.30 gtd 5000
+            //order 1001 buy 100 market [fok]
+            if(type != "order") return ParseError_UnknownType;
+            command.type = CommandType_NewOrder;
+            command.orderType = OrderType_Limit;
+            command.tif = TimeInForce_Day;
+            if((err = NextInt(tokens, command.orderId))) return err;
+            if((err = NextSide(tokens, "buy", "sell", command.side))) return err;
+            if((err = NextInt(tokens, command.qty))) return err;
+            if(!tokens.Next(token)) return ParseError_MissingField;
+            if(command.orderId < 0 || command.qty <= 0) return ParseError_OutOfRange;
+            if(token == "market") {
+                command.orderType = OrderType_Market;
+                command.tif = TimeInForce_IOC;
+                command.tick = InvalidTick;
+            } else {
+                int64_t mills;
+                if(!ParseMills(token, mills)) return ParseError_BadPrice;
+                if(mills <= 0) return ParseError_OutOfRange;
+                if(!MillsToTick(mills, command.tick)) return ParseError_BadPrice;
+            }
+            if(!tokens.Next(token)) return ParseError_None;
+            if(token == "ioc" && command.orderType == OrderType_Limit) {
+                command.tif = TimeInForce_IOC;
+            } else if(token == "fok") {
+                command.tif = TimeInForce_FOK;
+            } else if(token == "post" && command.orderType == OrderType_Limit) {
+                command.orderType = OrderType_PostOnly;
+            } else if(token == "gtd" && command.orderType == OrderType_Limit) {
+                command.tif = TimeInForce_GTD;
+                return NextTime(tokens, command.time);
+            } else {
+                return ParseError_UnknownType;
+            }
+            return ParseError_None;
+        }
+        case 'a': {
+            //amend 1004 600
+            //amend 1004 600 12.35
+            //amend all buy 600
+            //amend range buy 12.30 12.40 600
+            if(type != "amend") return ParseError_UnknownType;
+            if(!tokens.Next(token)) return ParseError_MissingField;
+            if(token == "all" || token == "range") {
+                command.type = CommandType_MassAmend;
+                command.tick = command.lastTick = InvalidTick;
+                if((err = NextSide(tokens, "buy", "sell", command.side))) return err;
+                if(token == "range" && (err = NextRange(tokens, command))) return err;
+                if((err = NextInt(tokens, command.qty))) return err;
+                if(command.qty <= 0) return ParseError_OutOfRange;
+                return ParseError_None;
+            }
+            command.type = CommandType_Amend;
+            if((err = ParseInt(token, command.orderId))) return err;
+            if((err = NextInt(tokens, command.qty))) return err;
+            if(command.orderId < 0 || command.qty <= 0) return ParseError_OutOfRange;
+            command.tick = InvalidTick;
+            if(!tokens.Next(token)) return ParseError_None;
+            int64_t mills;
+            if(!ParseMills(token, mills)) return ParseError_BadPrice;
+            if(mills <= 0) return ParseError_OutOfRange;
+            if(!MillsToTick(mills, command.tick)) return ParseError_BadPrice;
+            return ParseError_None;
+        }
+        case 'c': {
+            //cancel 1003
+            //cancel all                    (both sides)
+            //cancel all buy
+            //cancel range buy 12.30 12.40
+            if(type != "cancel") return ParseError_UnknownType;
+            if(!tokens.Next(token)) return ParseError_MissingField;
+            if(token == "all" || token == "range") {
+                command.type = CommandType_MassCancel;
+                command.side = BothSides;
+                command.tick = command.lastTick = InvalidTick;
+                if(token == "all" && tokens.done) return ParseError_None;
+                if((err = NextSide(tokens, "buy", "sell", command.side))) return err;
+                if(token == "range") return NextRange(tokens, command);
+                return ParseError_None;
+            }
+            command.type = CommandType_Cancel;
+            if((err = ParseInt(token, command.orderId))) return err;
+            if(command.orderId < 0) return ParseError_OutOfRange;
+            return ParseError_None;
+        }
+        case 'q': {
+            if(type != "q") return ParseError_UnknownType;
+            if(!tokens.Next(token)) return ParseError_MissingField;
+            if(token == "level") {
+                //q level ask 0
+                command.type = CommandType_QueryLevel;
+                if((err = NextSide(tokens, "bid", "ask", command.side))) return err;
+                return NextInt(tokens, command.qty);
+            } else if(token == "order") {
+                //q order 1001
+                command.type = CommandType_QueryOrder;
+                return NextInt(tokens, command.orderId);
+            } else if(token == "stats") {
+                //q stats
+                command.type = CommandType_QueryStats;
+                return ParseError_None;
+            }
+            return ParseError_UnknownType;
+        }
+        case 't': {
+            //time 5000
+            if(type != "time") return ParseError_UnknownType;
+            command.type = CommandType_Clock;
+            return NextTime(tokens, command.time);
+        }
+        case 's': {
+            //snapshot
+            if(type != "snapshot") return ParseError_UnknownType;
+            command.type = CommandType_Snapshot;
+            return ParseError_None;
+        }
+        default:
+            return ParseError_UnknownType;
+    }
+}
+
+static void AppendMills(int64_t mills, OutputBuffer &output) {
+    output.AppendInt(mills / 1000);
+    int frac = (int)(mills % 1000);
+    if(!frac) return;
+    char digits[4] = {'.', (char)('0' + frac / 100), (char)('0' + frac / 10 % 10), (char)('0' + frac % 10)};
+    size_t len = 4;
+    while(digits[len - 1] == '0') --len;
+    output.Append(string_view(digits, len));
+}
+
+void FormatReply(const Reply &reply, OutputBuffer &output) {
+    switch(reply.type) {
+        case ReplyType_Level:
+            output.Append(reply.side == OrderSide::OrderSide_Sell? "ask, ": "bid, ");
+            output.AppendInt(reply.id);
+            output.Append(", ");
+            output.AppendPx(reply.tick == InvalidTick? 0: TickToPx(reply.tick));
+            output.Append(", ");
+            output.AppendInt(reply.qty);
+            output.Append(", ");
+            output.AppendInt(reply.count);
+            output.Append('\n');
+            break;
+        case ReplyType_Order:
+            output.Append("order, ");
+            output.AppendInt(reply.id);
+            output.Append(", ");
+            output.Append(OrderStatusName(reply.status));
+            output.Append(", ");
+            output.AppendInt(reply.qty);
+            output.Append(", ");
+            output.AppendInt(reply.count);
+            output.Append('\n');
+            break;
+        case ReplyType_OrderNotFound:
+            output.Append("order, ");
+            output.AppendInt(reply.id);
+            output.Append(" Not found\n");
+            break;
+        case ReplyType_Invalid:
+            output.Append("Got Invalid Message: ");
+            output.AppendInt(reply.id);
+            output.Append('\n');
+            break;
+        case ReplyType_MassCancel:
+        case ReplyType_MassAmend:
+            output.Append(reply.type == ReplyType_MassCancel? "mass cancel, ": "mass amend, ");
+            output.Append(reply.side == OrderSide::OrderSide_Buy? "bid, ": reply.side == OrderSide::OrderSide_Sell? "ask, ": "all, ");
+            output.AppendInt(reply.count);
+            output.Append(", ");
+            output.AppendInt(reply.qty);
+            output.Append('\n');
+            break;
+        case ReplyType_Stats:
+            //the text comes from the book itself, see OrderBook::AppendStats
+        case ReplyType_None:
+            break;
+    }
+}
+
+void FormatInvalid(string_view message, OutputBuffer &output) {
+    output.Append("Got Invalid Message: ");
+    output.Append(message);
+    output.Append('\n');
+}
+
+void FormatEvent(const Event &event, OutputBuffer &output) {
+    switch(event.type) {
+        case EventType_Fill:
+            output.Append("fill, ");
+            output.AppendInt(event.orderId);
+            output.Append(", ");
+            output.AppendInt(event.restingId);
+            break;
+        case EventType_Amend:
+            output.Append("amend, ");
+            output.AppendInt(event.orderId);
+            break;
+        case EventType_Cancel:
+            output.Append("cancel, ");
+            output.AppendInt(event.orderId);
+            break;
+        case EventType_Reject:
+            output.Append("reject, ");
+            output.AppendInt(event.orderId);
+            break;
+    }
+    output.Append(", ");
+    output.AppendPx(event.tick == InvalidTick? 0: TickToPx(event.tick));
+    output.Append(", ");
+    output.AppendInt(event.qty);
+    output.Append(", ");
+    output.Append(OrderStatusName(event.status));
+    if(event.type == EventType_Fill) {
+        output.Append(", ");
+        output.Append(OrderStatusName(event.aggressorStatus));
+    }
+    output.Append('\n');
+}
+
+void FormatDepthUpdate(const DepthUpdate &update, OutputBuffer &output) {
+    if(update.type == DepthUpdateType_Snapshot) {
+        output.Append("snapshot, ");
+        output.AppendInt(update.qty);
+        output.Append(", ");
+        output.AppendInt(update.count);
+        output.Append('\n');
+        return;
+    }
+    output.Append(update.type == DepthUpdateType_Delta? "depth, ": "level, ");
+    output.Append(update.side == OrderSide::OrderSide_Buy? "bid, ": "ask, ");
+    output.AppendPx(TickToPx(update.tick));
+    output.Append(", ");
+    output.AppendInt(update.qty);
+    output.Append(", ");
+    output.AppendInt(update.count);
+    output.Append('\n');
+}
+
+void FormatCommand(const Command &command, OutputBuffer &output) {
+    switch(command.type) {
+        case CommandType_NewOrder:
+            output.Append("order ");
+            output.AppendInt(command.orderId);
+            output.Append(command.side == OrderSide::OrderSide_Buy? " buy ": " sell ");
+            output.AppendInt(command.qty);
+            if(command.orderType == OrderType_Market) {
+                output.Append(" market");
+                if(command.tif == TimeInForce_FOK) output.Append(" fok");
+                break;
+            }
+            output.Append(' ');
+            AppendMills(TickToMills(command.tick), output);
+            if(command.orderType == OrderType_PostOnly) output.Append(" post");
+            else if(command.tif == TimeInForce_IOC) output.Append(" ioc");
+            else if(command.tif == TimeInForce_FOK) output.Append(" fok");
+            else if(command.tif == TimeInForce_GTD) {
+                output.Append(" gtd ");
+                output.AppendInt((long)command.time);
+            }
+            break;
+        case CommandType_Amend:
+            output.Append("amend ");
+            output.AppendInt(command.orderId);
+            output.Append(' ');
+            output.AppendInt(command.qty);
+            if(command.tick != InvalidTick) {
+                output.Append(' ');
+                AppendMills(TickToMills(command.tick), output);
+            }
+            break;
+        case CommandType_Cancel:
+            output.Append("cancel ");
+            output.AppendInt(command.orderId);
+            break;
+        case CommandType_QueryLevel:
+            output.Append(command.side == OrderSide::OrderSide_Buy? "q level bid ": "q level ask ");
+            output.AppendInt(command.qty);
+            break;
+        case CommandType_QueryOrder:
+            output.Append("q order ");
+            output.AppendInt(command.orderId);
+            break;
+        case CommandType_QueryStats:
+            output.Append("q stats");
+            break;
+        case CommandType_Snapshot:
+            output.Append("snapshot");
+            break;
+        case CommandType_Clock:
+            output.Append("time ");
+            output.AppendInt((long)command.time);
+            break;
+        case CommandType_MassCancel:
+        case CommandType_MassAmend:
+            output.Append(command.type == CommandType_MassCancel? "cancel ": "amend ");
+            output.Append(command.tick == InvalidTick? "all": "range");
+            if(command.side != BothSides) output.Append(command.side == OrderSide::OrderSide_Buy? " buy": " sell");
+            if(command.tick != InvalidTick) {
+                output.Append(' ');
+                AppendMills(TickToMills(command.tick), output);
+                output.Append(' ');
+                AppendMills(TickToMills(command.lastTick), output);
+            }
+            if(command.type == CommandType_MassAmend) {
+                output.Append(' ');
+                output.AppendInt(command.qty);
+            }
+            break;
+    }
+    output.Append('\n');
+}
@@ -0,0 +1,69 @@
+#ifndef ORDERBOOK_TEXTPROTOCOL_H
+#define ORDERBOOK_TEXTPROTOCOL_H
+
+#include <string_view>
+
+#include "command.h"
+#include "events.h"
+#include "marketdata.h"
+#include "outputbuffer.h"
+
+typedef enum ParseError {
+    ParseError_None = 0,
+    ParseError_Empty,
+    ParseError_UnknownType,
+    ParseError_MissingField,
+    ParseError_BadNumber,
+    ParseError_BadSide,
+    ParseError_BadPrice,
+    ParseError_OutOfRange,
+} ParseError;
+
+//parses one space separated text message in place, nothing is allocated and nothing is thrown
+//order 1001 buy 100 12.30
+//order 1001 buy 100 12.30 ioc                 (also fok, or post for post-only)
+//order 1001 buy 100 12.30 gtd 5000            (good till the clock reaches 5000)
+//order 1001 buy 100 market                     (immediate or cancel, market fok for fill or kill)
+//amend 1004 600
+//amend 1004 600 12.35                          (cancel/replace: new price, loses queue priority, may trade)
+//cancel 1003
+//cancel all                                    (every order on both sides, or: cancel all buy|sell)
+//cancel range buy 12.30 12.40                  (every order on the side priced from 12.30 up to 12.40)
+//amend all buy 600                             (every order on the side, or: amend range buy 12.30 12.40 600)
+//q level ask 0
+//time 5000                                     (logical clock, expires the GTD orders due by then)
+//q order 1001
+//q stats
+//snapshot
+ParseError ParseMessage(std::string_view message, Command &command);
+
+//prices are read as fixed-point decimals straight into mills, at most 3 significant decimals
+bool ParseMills(std::string_view token, int64_t &mills);
+
+//replies, one line each
+//bid, 0, 12.15, 600, 1
+//order, 1004, New, 600, 0
+//order, 1004 Not found
+//mass cancel, bid, 120, 5400                   (side or all, number of orders, canceled qty)
+//mass amend, ask, 12, 1200                     (side, number of orders, leaves qty after the amend)
+void FormatReply(const Reply &reply, OutputBuffer &output);
+void FormatInvalid(std::string_view message, OutputBuffer &output);
+
+//execution reports, one line each
+//fill, 1002, 1001, 12.3, 100, Filled, Filled   (aggressor, resting, px, qty, resting status, aggressor status)
+//amend, 1004, 12.15, 600, New                  (order, px, new qty, status)
+//cancel, 1003, 12.4, 200, Canceled             (order, px, canceled qty, status), also for the unfilled rest of IOC/market orders
+//cancel, 1006, 12.4, 200, Expired              (GTD order whose time has come)
+//reject, 1005, 12.4, 200, Rejected             (FOK that can't fill, post-only that would trade; px 0 for market orders)
+void FormatEvent(const Event &event, OutputBuffer &output);
+
+//depth updates, one line each
+//depth, bid, 12.3, 500, 2      (side, px, new level qty, new order count, 0, 0 when the level is gone)
+//snapshot, 2, 1                (number of bid levels, number of ask levels that follow)
+//level, bid, 12.3, 500, 2
+void FormatDepthUpdate(const DepthUpdate &update, OutputBuffer &output);
+
+//writes the command back as a text message
+void FormatCommand(const Command &command, OutputBuffer &output);
+
+#endif //ORDERBOOK_TEXTPROTOCOL_H
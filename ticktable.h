@@ -0,0 +1,64 @@
+#ifndef ORDERBOOK_TICKTABLE_H
+#define ORDERBOOK_TICKTABLE_H
+
+#include <cmath>
+#include <cstdint>
+#include <climits>
+
+//integer price in ticks, prices are converted once on entry and never compared as doubles afterwards
+typedef int Tick;
+
+const Tick InvalidTick = INT_MIN;
+
+//tick table for SGX Stocks, REITs, business trusts, company warrants
+// Price Below 0.20 -> 0.001
+// Price 0.20 – 1.995 -> 0.005
+// Price 2.00 and above -> 0.01
+//ticks are numbered continuously across the bands, so adjacent ticks are always adjacent prices
+//prices are handled in mills (1/1000) internally, which is exact for all three bands
+
+const int64_t TickBand1Mills = 200;   //0.20
+const int64_t TickBand2Mills = 2000;  //2.00
+const int64_t TickBand1Size = 5;      //0.005
+const int64_t TickBand2Size = 10;     //0.01
+const Tick TickBand1First = (Tick)TickBand1Mills;
+const Tick TickBand2First = TickBand1First + (Tick)((TickBand2Mills - TickBand1Mills) / TickBand1Size);
+
+inline bool MillsToTick(int64_t mills, Tick &tick) {
+    int64_t t;
+    if(mills <= 0) {
+        return false;
+    } else if(mills < TickBand1Mills) {
+        t = mills;
+    } else if(mills < TickBand2Mills) {
+        if((mills - TickBand1Mills) % TickBand1Size) return false;
+        t = TickBand1First + (mills - TickBand1Mills) / TickBand1Size;
+    } else {
+        if((mills - TickBand2Mills) % TickBand2Size) return false;
+        t = TickBand2First + (mills - TickBand2Mills) / TickBand2Size;
+    }
+    if(t >= INT_MAX) return false;
+    tick = (Tick)t;
+    return true;
+}
+
+inline int64_t TickToMills(Tick tick) {
+    if(tick < TickBand1First) return tick;
+    if(tick < TickBand2First) return TickBand1Mills + (int64_t)(tick - TickBand1First) * TickBand1Size;
+    return TickBand2Mills + (int64_t)(tick - TickBand2First) * TickBand2Size;
+}
+
+//returns false if px is not on the tick grid of its band
+inline bool PxToTick(double px, Tick &tick) {
+    double scaled = px * 1000;
+    if(!(scaled > 0 && scaled < (double)INT64_MAX)) return false;
+    int64_t mills = std::llround(scaled);
+    if(std::fabs(scaled - (double)mills) > 1e-6 + scaled * 1e-12) return false;
+    return MillsToTick(mills, tick);
+}
+
+inline double TickToPx(Tick tick) {
+    return (double)TickToMills(tick) / 1000;
+}
+
+#endif //ORDERBOOK_TICKTABLE_H
@@ -0,0 +1,32 @@
+
+#include "timerwheel.h"
+
+void TimerWheel::Schedule(int id, Timestamp time) {
+    Place({id, time});
+}
+
+void TimerWheel::Place(const Entry &entry) {
+    int wheel = (31 - __builtin_clz(entry.time ^ now)) / 8;
+    int slot = (int)(entry.time >> (8 * wheel)) & (Slots - 1);
+    slots[wheel][slot].push_back(entry);
+    bits[wheel][slot >> 6] |= (uint64_t)1 << (slot & 63);
+    ++size;
+}
+
+Timestamp TimerWheel::NextSlot(int &wheel, int &slot) const {
+    if(!size) return now;
+    for(wheel = 0; wheel < Wheels; ++wheel) {
+        //entries sit strictly behind the slot now is in
+        int first = (int)((now >> (8 * wheel)) & (Slots - 1)) + 1;
+        for(int word = first >> 6; word < Slots / 64; ++word) {
+            uint64_t set = bits[wheel][word];
+            if(word == first >> 6) set &= ~(uint64_t)0 << (first & 63);
+            if(!set) continue;
+            slot = word * 64 + __builtin_ctzll(set);
+            //now with the bits of this wheel and the ones below replaced by the slot
+            uint64_t span = (uint64_t)1 << (8 * (wheel + 1));
+            return (Timestamp)(((uint64_t)now & ~(span - 1)) | ((uint64_t)slot << (8 * wheel)));
+        }
+    }
+    return now;
+}
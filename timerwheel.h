@@ -0,0 +1,69 @@
+#ifndef ORDERBOOK_TIMERWHEEL_H
+#define ORDERBOOK_TIMERWHEEL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "order.h"
+
+//hierarchical timing wheel over the 32 bit logical clock: Wheels wheels of Slots slots, a slot of wheel w spans Slots^w time units
+//an entry sits on the wheel of the highest byte in which its time differs from now, so scheduling is O(1) and an entry
+//moves down at most Wheels - 1 times before it fires
+//occupancy bitmaps find the next non-empty slot, so a clock jump costs nothing for the empty stretch it skips
+//entries can't be unscheduled, the owner checks on expiry whether an entry still means something
+class TimerWheel {
+
+public:
+    static const int Wheels = 4;
+    static const int Slots = 256;
+
+    Timestamp Now() const { return now; }
+    //scheduled entries that have not fired yet
+    size_t Size() const { return size; }
+
+    //pre-condition: time > Now()
+    void Schedule(int id, Timestamp time);
+
+    //moves the clock to time, expire(id, time) is called for every entry due by then, in time order,
+    //in schedule order within one time
+    //pre-condition: time >= Now()
+    template<typename F>
+    void Advance(Timestamp time, F expire) {
+        int wheel, slot;
+        while(now < time) {
+            Timestamp start = NextSlot(wheel, slot);
+            if(start == now || start > time) {
+                now = time;
+                return;
+            }
+            //the wheels below are empty, so nothing falls due before the slot starts
+            now = start;
+            due.swap(slots[wheel][slot]);
+            bits[wheel][slot >> 6] &= ~((uint64_t)1 << (slot & 63));
+            size -= due.size();
+            for(const Entry &entry: due) {
+                if(entry.time == now) expire(entry.id, entry.time); else Place(entry);
+            }
+            due.clear();
+        }
+    }
+
+private:
+    struct Entry {
+        int id;
+        Timestamp time;
+    };
+
+    //pre-condition: entry.time > now
+    void Place(const Entry &entry);
+    //first non-empty slot behind now on the lowest wheel that has one, returns the time it starts at, now if there is none
+    Timestamp NextSlot(int &wheel, int &slot) const;
+
+    Timestamp now = 0;
+    size_t size = 0;
+    std::vector<Entry> slots[Wheels][Slots];
+    uint64_t bits[Wheels][Slots / 64] = {};
+    std::vector<Entry> due;         //the slot being expired or moved down
+};
+
+#endif //ORDERBOOK_TIMERWHEEL_H